@@ -0,0 +1,124 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* startup-to-exit latency of the subcommands, which run once per hotkey:
+ * spawns the command over and over against the running server and
+ * reports the wall time of each run from spawn to reaped exit */
+
+#ifndef PWMIXER_BIN
+#define PWMIXER_BIN "pwmixer"
+#endif
+
+extern char **environ;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* returns the exit status of the command or a negative errno */
+static int run_once(char *argv[], posix_spawn_file_actions_t *actions)
+{
+    pid_t pid;
+    int res, status;
+
+    if ((res = posix_spawnp(&pid, argv[0], actions, NULL, argv, environ)) != 0)
+        return -res;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return -errno;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -ECHILD;
+}
+
+static void show_help(const char *name)
+{
+    fprintf(stdout, "%s [options] [-- command...]\n"
+        "  -h             Show this help\n"
+        "  -n RUNS        Number of timed runs (default 100)\n"
+        "  -w RUNS        Untimed warm-up runs (default 5)\n"
+        "  -v             Keep the output of the command\n"
+        "the command defaults to '%s list'\n",
+        name, PWMIXER_BIN);
+}
+
+int main(int argc, char *argv[])
+{
+    char *default_argv[] = { PWMIXER_BIN, "list", NULL }, **cmd = default_argv;
+    posix_spawn_file_actions_t actions;
+    int c, i, res, n_runs = 100, n_warmup = 5, n_failed = 0;
+    int verbose = 0;
+    double t0, *times;
+
+    while ((c = getopt(argc, argv, "hn:w:v")) != -1) {
+        switch (c) {
+        case 'n': n_runs = atoi(optarg); break;
+        case 'w': n_warmup = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        case 'h':
+            show_help(argv[0]);
+            return 0;
+        default:
+            show_help(argv[0]);
+            return -1;
+        }
+    }
+    if (optind < argc)
+        cmd = argv + optind;
+    if (n_runs <= 0 || n_warmup < 0) {
+        fprintf(stderr, "need at least one run\n");
+        return -1;
+    }
+    if ((times = calloc(n_runs, sizeof(double))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    if (!verbose)
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+            "/dev/null", O_WRONLY, 0);
+
+    for (i = 0; i < n_warmup; i++) {
+        if ((res = run_once(cmd, &actions)) != 0) {
+            fprintf(stderr, "%s failed: %s\n", cmd[0],
+                res < 0 ? strerror(-res) : "non-zero exit");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < n_runs; i++) {
+        t0 = now_ms();
+        if (run_once(cmd, &actions) != 0)
+            n_failed++;
+        times[i] = now_ms() - t0;
+    }
+    qsort(times, n_runs, sizeof(double), cmp_double);
+
+    printf("command:");
+    for (i = 0; cmd[i]; i++)
+        printf(" %s", cmd[i]);
+    printf("\nruns:%d failed:%d\n", n_runs, n_failed);
+    printf("%10s %10s %10s %10s\n", "min(ms)", "p50(ms)", "p95(ms)", "max(ms)");
+    printf("%10.3f %10.3f %10.3f %10.3f\n", times[0], times[n_runs / 2],
+        times[n_runs * 95 / 100], times[n_runs - 1]);
+
+    posix_spawn_file_actions_destroy(&actions);
+    free(times);
+    return n_failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,107 @@
+#include "curve.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* cost of converting a Props update worth of channel volumes, the
+ * closed-form math next to the scalar and the batch table lookups */
+
+#define CHANNELS    64      /* SPA_AUDIO_MAX_CHANNELS */
+#define FULL        0x1000
+#define MAX         0xA000
+#define ITERATIONS  (1u << 18)
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *curve, const char *name, double elapsed)
+{
+    printf("%-8s %-14s %10.2f\n", curve, name,
+        elapsed / ITERATIONS / CHANNELS * 1e9);
+}
+
+static void run(const char *name, double (*ref_to)(double), double (*ref_from)(double),
+    const float *gains, const uint32_t *volumes)
+{
+    struct curve *curve = curve_parse(name, FULL, MAX);
+    uint32_t out[CHANNELS], i, c;
+    float lin[CHANNELS];
+    volatile float sink;
+    double t0;
+
+    if (curve == NULL) {
+        fprintf(stderr, "cannot build curve %s\n", name);
+        exit(1);
+    }
+
+    /* sink keeps the loops from being optimized away */
+    t0 = now_s();
+    for (i = 0; i < ITERATIONS; i++) {
+        for (c = 0; c < CHANNELS; c++) {
+            double v = ref_from(gains[(i + c) % CHANNELS]) * FULL;
+            out[c] = v < MAX ? lround(v) : MAX;
+        }
+        sink = out[i % CHANNELS];
+    }
+    report(name, "from math", now_s() - t0);
+
+    t0 = now_s();
+    for (i = 0; i < ITERATIONS; i++) {
+        for (c = 0; c < CHANNELS; c++)
+            out[c] = curve_from_linear(curve, gains[(i + c) % CHANNELS]);
+        sink = out[i % CHANNELS];
+    }
+    report(name, "from lut", now_s() - t0);
+
+    t0 = now_s();
+    for (i = 0; i < ITERATIONS; i++) {
+        curve_from_linear_n(curve, gains + (i & 1), out, CHANNELS);
+        sink = out[i % CHANNELS];
+    }
+    report(name, "from lut batch", now_s() - t0);
+
+    t0 = now_s();
+    for (i = 0; i < ITERATIONS; i++) {
+        for (c = 0; c < CHANNELS; c++)
+            lin[c] = ref_to((double)volumes[(i + c) % CHANNELS] / FULL);
+        sink = lin[i % CHANNELS];
+    }
+    report(name, "to math", now_s() - t0);
+
+    t0 = now_s();
+    for (i = 0; i < ITERATIONS; i++) {
+        curve_to_linear_n(curve, volumes + (i & 1), lin, CHANNELS);
+        sink = lin[i % CHANNELS];
+    }
+    report(name, "to lut batch", now_s() - t0);
+
+    (void)sink;
+    curve_free(curve);
+}
+
+static double cubic(double p) { return p * p * p; }
+static double cubic_inv(double g) { return cbrt(g); }
+static double db(double p) { return p > 0 ? pow(10.0, CURVE_DB_FLOOR * (1.0 - p) / 20.0) : 0; }
+static double db_inv(double g) { return fmax(0.0, 1.0 - 20.0 * log10(g) / CURVE_DB_FLOOR); }
+
+int main(int argc, char *argv[])
+{
+    float gains[CHANNELS + 1];
+    uint32_t volumes[CHANNELS + 1], i;
+
+    srand(1);
+    for (i = 0; i <= CHANNELS; i++) {
+        gains[i] = (float)rand() / RAND_MAX * 1.5f;
+        volumes[i] = rand() % (MAX + 1);
+    }
+
+    printf("%-8s %-14s %10s\n", "curve", "conversion", "ns/chan");
+    run("cubic", cubic, cubic_inv, gains, volumes);
+    run("db", db, db_inv, gains, volumes);
+    return 0;
+}
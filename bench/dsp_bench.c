@@ -0,0 +1,61 @@
+#include "dsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* throughput of the level kernels over typical quantum sizes, these run
+ * once per period for every metered node */
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, dsp_level_func_t func,
+    const float *samples, uint32_t n_samples)
+{
+    uint32_t i, iterations = (64u << 20) / n_samples;
+    volatile float sink;
+    float peak = 0.0f, sum_sq = 0.0f;
+    double t0, elapsed;
+
+    t0 = now_s();
+    for (i = 0; i < iterations; i++) {
+        peak = 0.0f;
+        sum_sq = 0.0f;
+        func(samples + (i & 1), n_samples, &peak, &sum_sq);
+    }
+    elapsed = now_s() - t0;
+    sink = peak + sum_sq;
+    (void)sink;
+
+    printf("%-8s %8u %12.1f %12.1f\n", name, n_samples,
+        (double)iterations * n_samples / elapsed / 1e6,
+        elapsed / iterations * 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t i, n, max = 8192, flags = dsp_init();
+    float *samples = malloc((max + 1) * sizeof(float));
+
+    srand(1);
+    for (i = 0; i <= max; i++)
+        samples[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+
+    printf("%-8s %8s %12s %12s\n", "kernel", "samples", "Msamples/s", "ns/call");
+    for (n = 64; n <= max; n *= 4) {
+        run("c", dsp_level_c, samples, n);
+#ifdef DSP_X86
+        if (flags & DSP_CPU_SSE2)
+            run("sse2", dsp_level_sse2, samples, n);
+        if (flags & DSP_CPU_AVX2)
+            run("avx2", dsp_level_avx2, samples, n);
+#endif
+    }
+
+    free(samples);
+    return 0;
+}
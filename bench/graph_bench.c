@@ -0,0 +1,423 @@
+#include "pwmixer.h"
+#include "journal.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <curses.h>
+
+#include <spa/param/props.h>
+#include <spa/pod/builder.h>
+#include <pipewire/pipewire.h>
+
+/* builds a synthetic graph of N nodes with M ports each and K links
+ * between them, and pushes it through the same registry, info and param
+ * handlers a server would drive, then repaints into an offscreen
+ * terminal and tears the graph down again; with -r a journal written by
+ * pwmixer --record is fed instead, with -z ports and links are fed the
+ * way --lazy-ports sees them, as globals without info events, and -c
+ * feeds the graph both ways to compare their peak rss */
+
+struct graph {
+    uint32_t n_nodes;
+    uint32_t n_ports;
+    uint32_t n_links;
+    uint32_t next_id;
+    uint32_t *node_ids;
+    uint32_t *port_ids;
+    uint32_t *link_ids;
+    uint64_t n_events;
+    bool lazy;
+};
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static long peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static const char *node_class(uint32_t i)
+{
+    switch (i % 4) {
+    case 0: return "Audio/Sink";
+    case 1: return "Audio/Source";
+    default: return "Stream/Output/Audio";
+    }
+}
+
+static bool node_is_input(uint32_t i)
+{
+    return i % 4 == 0;
+}
+
+static void emit_volume(struct ctl *ctl, struct graph *g, uint32_t id, float volume)
+{
+    uint8_t buffer[1024];
+    struct spa_pod_builder b;
+    struct spa_pod_frame f;
+    struct spa_pod *param;
+    float channels[2] = { volume, volume };
+
+    spa_pod_builder_init(&b, buffer, sizeof(buffer));
+    spa_pod_builder_push_object(&b, &f, SPA_TYPE_OBJECT_Props, SPA_PARAM_Props);
+    spa_pod_builder_prop(&b, SPA_PROP_volume, 0);
+    spa_pod_builder_float(&b, 1.0f);
+    spa_pod_builder_prop(&b, SPA_PROP_mute, 0);
+    spa_pod_builder_bool(&b, false);
+    spa_pod_builder_prop(&b, SPA_PROP_channelVolumes, 0);
+    spa_pod_builder_array(&b, sizeof(float), SPA_TYPE_Float, 2, channels);
+    param = spa_pod_builder_pop(&b, &f);
+
+    ctl_emit_param(ctl, id, SPA_PARAM_Props, param);
+    g->n_events++;
+}
+
+static void add_node(struct ctl *ctl, struct graph *g, uint32_t i)
+{
+    uint32_t id = g->node_ids[i] = g->next_id++;
+    char name[64], desc[64];
+    struct spa_dict_item items[3];
+    struct spa_dict props;
+    struct spa_param_info params[1];
+    struct pw_node_info info;
+
+    snprintf(name, sizeof(name), "bench.node.%u", i);
+    snprintf(desc, sizeof(desc), "Bench node %u", i);
+    items[0] = SPA_DICT_ITEM_INIT(PW_KEY_MEDIA_CLASS, node_class(i));
+    items[1] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_NAME, name);
+    items[2] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_DESCRIPTION, desc);
+    props = SPA_DICT_INIT(items, 3);
+
+    ctl_add_global(ctl, id, PW_PERM_R | PW_PERM_W | PW_PERM_X,
+        PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, &props);
+
+    params[0] = (struct spa_param_info) {
+        .id = SPA_PARAM_Props,
+        .flags = SPA_PARAM_INFO_READ | SPA_PARAM_INFO_WRITE,
+    };
+    info = (struct pw_node_info) {
+        .id = id,
+        .change_mask = PW_NODE_CHANGE_MASK_PROPS | PW_NODE_CHANGE_MASK_PARAMS,
+        .props = &props,
+        .params = params,
+        .n_params = 1,
+    };
+    ctl_emit_info(ctl, id, &info);
+    g->n_events += 2;
+
+    emit_volume(ctl, g, id, 0.5f);
+}
+
+static void add_port(struct ctl *ctl, struct graph *g, uint32_t node, uint32_t p)
+{
+    uint32_t id = g->port_ids[node * g->n_ports + p] = g->next_id++;
+    char node_id[16], port_name[32];
+    struct spa_dict_item items[3];
+    struct spa_dict props;
+    struct pw_port_info info;
+
+    snprintf(node_id, sizeof(node_id), "%u", g->node_ids[node]);
+    snprintf(port_name, sizeof(port_name), "port_%u", p);
+    items[0] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_ID, node_id);
+    items[1] = SPA_DICT_ITEM_INIT(PW_KEY_PORT_NAME, port_name);
+    items[2] = SPA_DICT_ITEM_INIT(PW_KEY_PORT_DIRECTION,
+        node_is_input(node) ? "in" : "out");
+    props = SPA_DICT_INIT(items, 3);
+
+    ctl_add_global(ctl, id, PW_PERM_R, PW_TYPE_INTERFACE_Port,
+        PW_VERSION_PORT, &props);
+    g->n_events++;
+    if (g->lazy)
+        return;
+
+    info = (struct pw_port_info) {
+        .id = id,
+        .direction = node_is_input(node) ? PW_DIRECTION_INPUT : PW_DIRECTION_OUTPUT,
+        .change_mask = PW_PORT_CHANGE_MASK_PROPS,
+        .props = &props,
+    };
+    ctl_emit_info(ctl, id, &info);
+    g->n_events++;
+}
+
+/* links go from a stream or source port to a port of a sink, picked
+ * with a fixed sequence so runs are comparable */
+static void add_link(struct ctl *ctl, struct graph *g, uint32_t i)
+{
+    uint32_t id = g->link_ids[i] = g->next_id++;
+    uint32_t n_sinks = (g->n_nodes + 3) / 4, n_others = g->n_nodes - n_sinks;
+    uint32_t out, in, p = i % g->n_ports;
+    uint32_t r = i * 2654435761U;
+    char ids[4][16];
+    struct spa_dict_item items[4];
+    struct spa_dict props;
+    struct pw_link_info info;
+
+    /* node indices of the form 4k are sinks, the rest feed into them */
+    out = r % n_others;
+    out = out / 3 * 4 + out % 3 + 1;
+    in = (r >> 16) % n_sinks * 4;
+
+    snprintf(ids[0], sizeof(ids[0]), "%u", g->node_ids[out]);
+    snprintf(ids[1], sizeof(ids[1]), "%u", g->port_ids[out * g->n_ports + p]);
+    snprintf(ids[2], sizeof(ids[2]), "%u", g->node_ids[in]);
+    snprintf(ids[3], sizeof(ids[3]), "%u", g->port_ids[in * g->n_ports + p]);
+    items[0] = SPA_DICT_ITEM_INIT(PW_KEY_LINK_OUTPUT_NODE, ids[0]);
+    items[1] = SPA_DICT_ITEM_INIT(PW_KEY_LINK_OUTPUT_PORT, ids[1]);
+    items[2] = SPA_DICT_ITEM_INIT(PW_KEY_LINK_INPUT_NODE, ids[2]);
+    items[3] = SPA_DICT_ITEM_INIT(PW_KEY_LINK_INPUT_PORT, ids[3]);
+    props = SPA_DICT_INIT(items, 4);
+
+    ctl_add_global(ctl, id, PW_PERM_R, PW_TYPE_INTERFACE_Link,
+        PW_VERSION_LINK, &props);
+    g->n_events++;
+    if (g->lazy)
+        return;
+
+    info = (struct pw_link_info) {
+        .id = id,
+        .output_node_id = g->node_ids[out],
+        .output_port_id = g->port_ids[out * g->n_ports + p],
+        .input_node_id = g->node_ids[in],
+        .input_port_id = g->port_ids[in * g->n_ports + p],
+        .change_mask = PW_LINK_CHANGE_MASK_PROPS,
+    };
+    ctl_emit_info(ctl, id, &info);
+    g->n_events++;
+}
+
+static void report(const char *phase, uint64_t n_events, double ms)
+{
+    printf("%-10s %10llu %12.3f %14.0f %10ld\n", phase,
+        (unsigned long long)n_events, ms,
+        ms > 0 ? n_events / ms * 1e3 : 0.0, peak_rss_kb());
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* one record at a time, so the cost of every event can be profiled */
+static int replay(struct ctl *ctl, const char *path, uint32_t n_frames)
+{
+    struct journal *journal;
+    double t0, t, prev, *costs = NULL, *tmp;
+    size_t n = 0, max = 0;
+    uint32_t i;
+    int res;
+
+    if ((journal = journal_open(path, false)) == NULL) {
+        fprintf(stderr, "cannot open journal %s\n", path);
+        return -1;
+    }
+
+    t0 = prev = now_ms();
+    while ((res = ctl_replay(ctl, journal, UINT64_MAX, 1)) > 0) {
+        t = now_ms();
+        if (n == max) {
+            max = max ? max * 2 : 4096;
+            if (!(tmp = realloc(costs, max * sizeof(double))))
+                break;
+            costs = tmp;
+        }
+        costs[n++] = t - prev;
+        prev = t;
+    }
+    report("replay", n, prev - t0);
+    if (res < 0)
+        fprintf(stderr, "journal is corrupt after %zu records\n", n);
+
+    t0 = now_ms();
+    for (i = 0; i < n_frames; i++)
+        ctl_screen_render(ctl);
+    report("render", n_frames, now_ms() - t0);
+
+    if (n > 0) {
+        qsort(costs, n, sizeof(double), cmp_double);
+        printf("per event(us): p50 %.3f p99 %.3f max %.3f\n",
+            costs[n / 2] * 1e3, costs[n * 99 / 100] * 1e3, costs[n - 1] * 1e3);
+    }
+    free(costs);
+    journal_close(journal);
+    return res < 0 ? -1 : 0;
+}
+
+/* each way in a child of its own, so neither peak includes the other.
+ * returns true in the children, which go on to feed the graph, and
+ * false in the parent once both are done */
+static bool compare_lazy(struct graph *g, int *res)
+{
+    long rss[2];
+    struct rusage usage;
+    int i, status;
+    pid_t pid;
+
+    for (i = 0; i < 2; i++) {
+        fflush(stdout);
+        if ((pid = fork()) == 0) {
+            g->lazy = i;
+            return true;
+        }
+        if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s run failed\n", i ? "lazy" : "eager");
+            *res = -1;
+            return false;
+        }
+        rss[i] = usage.ru_maxrss;
+        printf("\n");
+    }
+
+    printf("peak rss(KiB): eager %ld lazy %ld, %.0f bytes saved per port and link\n",
+        rss[0], rss[1], (rss[0] - rss[1]) * 1024.0 /
+        ((double)g->n_nodes * g->n_ports + g->n_links));
+    *res = 0;
+    return false;
+}
+
+static void show_help(const char *name)
+{
+    fprintf(stdout, "%s [options]\n"
+        "  -h             Show this help\n"
+        "  -n NODES       Number of nodes (default 1000)\n"
+        "  -p PORTS       Ports per node (default 4)\n"
+        "  -l LINKS       Number of links (default 2000)\n"
+        "  -f FRAMES      Frames to render (default 100)\n"
+        "  -r FILE        Replay a recorded journal instead of a synthetic graph\n"
+        "  -z             Keep ports and links lazily, as --lazy-ports does\n"
+        "  -c             Run eagerly and with -z, and compare the peak rss\n",
+        name);
+}
+
+int main(int argc, char *argv[])
+{
+    struct graph g = { .n_nodes = 1000, .n_ports = 4, .n_links = 2000 };
+    uint32_t i, p, n_frames = 100;
+    const char *journal_path = NULL;
+    struct ctl *ctl;
+    FILE *null_out, *null_in;
+    double t0;
+    size_t props_size;
+    uint32_t n_strings;
+    bool compare = false;
+    int c, res;
+
+    while ((c = getopt(argc, argv, "hn:p:l:f:r:zc")) != -1) {
+        switch (c) {
+        case 'n': g.n_nodes = atoi(optarg); break;
+        case 'p': g.n_ports = atoi(optarg); break;
+        case 'l': g.n_links = atoi(optarg); break;
+        case 'f': n_frames = atoi(optarg); break;
+        case 'r': journal_path = optarg; break;
+        case 'z': g.lazy = true; break;
+        case 'c': compare = true; break;
+        case 'h':
+            show_help(argv[0]);
+            return 0;
+        default:
+            show_help(argv[0]);
+            return -1;
+        }
+    }
+    if (g.n_nodes < 2 || g.n_ports == 0) {
+        fprintf(stderr, "need at least 2 nodes and 1 port per node\n");
+        return -1;
+    }
+    if (compare && journal_path == NULL && !compare_lazy(&g, &res))
+        return res;
+
+    pw_init(NULL, NULL);
+    g.next_id = 100;
+    g.node_ids = calloc(g.n_nodes, sizeof(uint32_t));
+    g.port_ids = calloc(g.n_nodes * g.n_ports, sizeof(uint32_t));
+    g.link_ids = calloc(g.n_links, sizeof(uint32_t));
+    if (!g.node_ids || !g.port_ids || (g.n_links && !g.link_ids) ||
+        !(ctl = ctl_new())) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    ctl_set_lazy_ports(ctl, g.lazy);
+
+    /* curses needs a terminal description even when nobody looks */
+    setenv("TERM", "xterm", 0);
+    null_out = fopen("/dev/null", "w");
+    null_in = fopen("/dev/null", "r");
+    if (!null_out || !null_in || ctl_screen_open(ctl, null_out, null_in) < 0) {
+        fprintf(stderr, "cannot open offscreen terminal\n");
+        return -1;
+    }
+    resize_term(60, 200);
+
+    if (journal_path != NULL) {
+        printf("journal:%s frames:%u\n", journal_path, n_frames);
+        printf("%-10s %10s %12s %14s %10s\n",
+            "phase", "events", "time(ms)", "events/s", "rss(KiB)");
+        c = replay(ctl, journal_path, n_frames);
+        ctl_free(ctl);
+        return c;
+    }
+
+    printf("nodes:%u ports/node:%u links:%u frames:%u%s\n",
+        g.n_nodes, g.n_ports, g.n_links, n_frames, g.lazy ? " lazy" : "");
+    printf("%-10s %10s %12s %14s %10s\n",
+        "phase", "events", "time(ms)", "events/s", "rss(KiB)");
+
+    t0 = now_ms();
+    for (i = 0; i < g.n_nodes; i++) {
+        add_node(ctl, &g, i);
+        for (p = 0; p < g.n_ports; p++)
+            add_port(ctl, &g, i, p);
+    }
+    report("index", g.n_events, now_ms() - t0);
+    props_size = ctl_props_size(ctl, &n_strings);
+
+    g.n_events = 0;
+    t0 = now_ms();
+    for (i = 0; i < g.n_links; i++)
+        add_link(ctl, &g, i);
+    report("grouping", g.n_events, now_ms() - t0);
+
+    /* every frame follows a volume change, as a user holding a key
+     * would cause */
+    g.n_events = 0;
+    t0 = now_ms();
+    for (i = 0; i < n_frames; i++) {
+        emit_volume(ctl, &g, g.node_ids[(i * 4) % g.n_nodes], (i % 100) / 100.0f);
+        ctl_screen_render(ctl);
+    }
+    report("render", g.n_events, now_ms() - t0);
+
+    g.n_events = 0;
+    t0 = now_ms();
+    for (i = 0; i < g.n_links; i++, g.n_events++)
+        ctl_remove_global(ctl, g.link_ids[i]);
+    for (i = 0; i < g.n_nodes * g.n_ports; i++, g.n_events++)
+        ctl_remove_global(ctl, g.port_ids[i]);
+    for (i = 0; i < g.n_nodes; i++, g.n_events++)
+        ctl_remove_global(ctl, g.node_ids[i]);
+    report("destroy", g.n_events, now_ms() - t0);
+    printf("interned properties: %u strings, %zu KiB\n",
+        n_strings, props_size / 1024);
+
+    ctl_free(ctl);
+    fclose(null_out);
+    fclose(null_in);
+    free(g.node_ids);
+    free(g.port_ids);
+    free(g.link_ids);
+    pw_deinit();
+    return 0;
+}
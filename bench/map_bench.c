@@ -0,0 +1,82 @@
+#include "map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* replays the lookups done while resolving a registry burst: one per
+ * port and four per link, against a linear list (the old find_node)
+ * and against the id index */
+
+struct object {
+    uint32_t id;
+    struct object *next;
+};
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static struct object *list_find(struct object *head, uint32_t id)
+{
+    for (; head; head = head->next)
+        if (head->id == id)
+            return head;
+    return NULL;
+}
+
+static void run(uint32_t n_nodes)
+{
+    uint32_t ports = 4, n_objects = n_nodes * (1 + ports + ports / 2);
+    uint32_t i, id, n_links = n_nodes * ports / 2, n_lookups;
+    struct object *objects = calloc(n_objects, sizeof(struct object));
+    struct object *head = NULL, *tail = NULL;
+    struct idmap *map = idmap_new();
+    volatile uintptr_t sink = 0;
+    double t0, t_list, t_map;
+
+    for (i = 0; i < n_objects; i++) {
+        objects[i].id = i;
+        if (tail)
+            tail->next = &objects[i];
+        else
+            head = &objects[i];
+        tail = &objects[i];
+        idmap_put(map, i, &objects[i]);
+    }
+
+    n_lookups = n_nodes * ports + n_links * 4;
+
+    t0 = now_ms();
+    for (i = 0; i < n_lookups; i++) {
+        id = (i * 2654435761U) % n_objects;
+        sink += (uintptr_t)list_find(head, id);
+    }
+    t_list = now_ms() - t0;
+
+    t0 = now_ms();
+    for (i = 0; i < n_lookups; i++) {
+        id = (i * 2654435761U) % n_objects;
+        sink += (uintptr_t)idmap_get(map, id);
+    }
+    t_map = now_ms() - t0;
+
+    printf("%8u %8u %10u %12.3f %12.3f\n",
+        n_nodes, n_objects, n_lookups, t_list, t_map);
+
+    idmap_free(map);
+    free(objects);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t n, max = argc > 1 ? atoi(argv[1]) : 8000;
+
+    printf("%8s %8s %10s %12s %12s\n",
+        "nodes", "objects", "lookups", "list(ms)", "idmap(ms)");
+    for (n = 125; n <= max; n *= 2)
+        run(n);
+    return 0;
+}
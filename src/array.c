@@ -7,7 +7,7 @@
 
 struct array *array_new(size_t item_size)
 {
-    struct array *arr = (struct array*)malloc(sizeof(struct array*));
+    struct array *arr = (struct array*)malloc(sizeof(struct array));
     if (!arr) {
         return NULL;
     }
@@ -0,0 +1,363 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "curve.h"
+
+/* forward entries before the one of position CURVE_FORWARD_EXACT, less
+ * the ones a table of steps alone would have had */
+#define FORWARD_OFFSET  (CURVE_FORWARD_EXACT - (CURVE_FORWARD_EXACT >> CURVE_FORWARD_SHIFT))
+#define INVERSE_SHIFT   (23 - CURVE_INVERSE_BITS)
+#define INVERSE_MASK    ((1u << INVERSE_SHIFT) - 1)
+
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* segment of the custom curve holding position or gain, the last one
+ * also covers what lies beyond it */
+static uint32_t find_segment(const struct curve *curve, double value, bool by_gain)
+{
+    uint32_t i;
+
+    for (i = 0; i + 2 < curve->n_points; i++) {
+        if (value <= (by_gain ? curve->points[i + 1].gain : curve->points[i + 1].position))
+            break;
+    }
+    return i;
+}
+
+float curve_eval(const struct curve *curve, float position)
+{
+    const struct curve_point *a, *b;
+    double p = position > 0 ? position : 0, gain;
+
+    switch (curve->type) {
+    case CURVE_LINEAR:
+        gain = p;
+        break;
+    case CURVE_CUBIC:
+        gain = p * p * p;
+        break;
+    case CURVE_DB:
+        if (p > 1)
+            gain = p * p * p;
+        else
+            gain = p > 0 ? pow(10.0, curve->floor_db * (1.0 - p) / 20.0) : 0;
+        break;
+    case CURVE_CUSTOM:
+        a = &curve->points[find_segment(curve, p, false)];
+        b = a + 1;
+        gain = a->gain + (p - a->position) * (b->gain - a->gain) /
+            (b->position - a->position);
+        break;
+    default:
+        gain = 0;
+        break;
+    }
+    if (gain < 0)
+        gain = 0;
+    return gain < CURVE_MAX_GAIN ? gain : CURVE_MAX_GAIN;
+}
+
+/* not clamped to the positions there are, so the table keeps going
+ * straight past both ends and the lookup clamps instead */
+static double invert(const struct curve *curve, double g)
+{
+    const struct curve_point *a, *b;
+    double p;
+
+    switch (curve->type) {
+    case CURVE_LINEAR:
+        p = g;
+        break;
+    case CURVE_CUBIC:
+        p = cbrt(g);
+        break;
+    case CURVE_DB:
+        if (g > 1)
+            p = cbrt(g);
+        else
+            p = 1.0 - 20.0 * log10(g) / curve->floor_db;
+        break;
+    case CURVE_CUSTOM:
+        a = &curve->points[find_segment(curve, g, true)];
+        b = a + 1;
+        if (b->gain == a->gain)
+            p = a->position;
+        else
+            p = a->position + (g - a->gain) * (b->position - a->position) /
+                (b->gain - a->gain);
+        break;
+    default:
+        p = 0;
+        break;
+    }
+    return p;
+}
+
+float curve_invert(const struct curve *curve, float gain)
+{
+    double p, top = (double)curve->max / curve->full;
+
+    if (!(gain > 0))
+        return 0;
+    p = invert(curve, gain);
+    if (p < 0)
+        p = 0;
+    return p < top ? p : top;
+}
+
+static struct curve *build(struct curve *curve)
+{
+    uint32_t i, n_forward, top;
+    int res = -ENOMEM;
+
+    /* the gains clamped at CURVE_MAX_GAIN would all map back to one
+     * position and stepping through them would get stuck */
+    curve->max_gain = curve_eval(curve, (float)curve->max / curve->full);
+    if (curve->max_gain >= CURVE_MAX_GAIN) {
+        res = -ERANGE;
+        goto error;
+    }
+    if (curve->max_gain < CURVE_MIN_GAIN)
+        curve->max_gain = CURVE_MIN_GAIN;
+
+    /* one entry past the last position to interpolate towards */
+    n_forward = (curve->max >> CURVE_FORWARD_SHIFT) + 2 +
+        FORWARD_OFFSET;
+    if (!(curve->forward = malloc(n_forward * sizeof(float))))
+        goto error;
+    for (i = 0; i < n_forward; i++)
+        curve->forward[i] = curve_eval(curve, (float)(i < CURVE_FORWARD_EXACT ? i :
+            (i - FORWARD_OFFSET) << CURVE_FORWARD_SHIFT) / curve->full);
+
+    /* one entry past the largest gain to interpolate towards */
+    curve->inverse_base = float_bits(CURVE_MIN_GAIN);
+    top = float_bits(curve->max_gain) - curve->inverse_base;
+    curve->n_inverse = (top >> INVERSE_SHIFT) + 2;
+    if (!(curve->inverse = malloc(curve->n_inverse * sizeof(float))))
+        goto error;
+    for (i = 0; i < curve->n_inverse; i++)
+        curve->inverse[i] = invert(curve,
+            bits_float(curve->inverse_base + (i << INVERSE_SHIFT)));
+    return curve;
+
+error:
+    curve_free(curve);
+    errno = -res;
+    return NULL;
+}
+
+static struct curve *alloc_curve(enum curve_type type, uint32_t full, uint32_t max)
+{
+    struct curve *curve;
+
+    if (full == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(curve = calloc(1, sizeof(struct curve))))
+        return NULL;
+    curve->type = type;
+    curve->full = full;
+    curve->max = max;
+    return curve;
+}
+
+struct curve *curve_new(enum curve_type type, uint32_t full, uint32_t max)
+{
+    struct curve *curve;
+
+    if (type == CURVE_DB)
+        return curve_new_db(CURVE_DB_FLOOR, full, max);
+    if (type != CURVE_LINEAR && type != CURVE_CUBIC) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(curve = alloc_curve(type, full, max)))
+        return NULL;
+    return build(curve);
+}
+
+struct curve *curve_new_db(float floor_db, uint32_t full, uint32_t max)
+{
+    struct curve *curve;
+
+    if (!(floor_db < 0) || !isfinite(floor_db)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(curve = alloc_curve(CURVE_DB, full, max)))
+        return NULL;
+    curve->floor_db = floor_db;
+    return build(curve);
+}
+
+struct curve *curve_new_custom(const struct curve_point *points,
+    uint32_t n_points, uint32_t full, uint32_t max)
+{
+    struct curve *curve;
+    uint32_t i;
+
+    if (n_points < 2 || points[0].position != 0 || !(points[0].gain >= 0))
+        goto invalid;
+    for (i = 1; i < n_points; i++) {
+        if (!(points[i].position > points[i - 1].position) ||
+            !(points[i].gain >= points[i - 1].gain))
+            goto invalid;
+    }
+
+    if (!(curve = alloc_curve(CURVE_CUSTOM, full, max)))
+        return NULL;
+    if (!(curve->points = malloc(n_points * sizeof(struct curve_point)))) {
+        free(curve);
+        return NULL;
+    }
+    memcpy(curve->points, points, n_points * sizeof(struct curve_point));
+    curve->n_points = n_points;
+    return build(curve);
+
+invalid:
+    errno = EINVAL;
+    return NULL;
+}
+
+struct curve *curve_parse(const char *str, uint32_t full, uint32_t max)
+{
+    struct curve_point *points = NULL, *tmp;
+    struct curve *curve = NULL;
+    uint32_t n_points = 0;
+    const char *p;
+    char *end;
+    double floor_db;
+
+    if (strcmp(str, "linear") == 0)
+        return curve_new(CURVE_LINEAR, full, max);
+    if (strcmp(str, "cubic") == 0)
+        return curve_new(CURVE_CUBIC, full, max);
+    if (strcmp(str, "db") == 0)
+        return curve_new_db(CURVE_DB_FLOOR, full, max);
+    if (strncmp(str, "db:", 3) == 0) {
+        floor_db = strtod(str + 3, &end);
+        if (end == str + 3 || *end) {
+            errno = EINVAL;
+            return NULL;
+        }
+        return curve_new_db(floor_db, full, max);
+    }
+
+    for (p = str; ; p = end + 1) {
+        if (!(tmp = realloc(points, (n_points + 1) * sizeof(struct curve_point))))
+            goto done;
+        points = tmp;
+        points[n_points].position = strtod(p, &end) / 100.0;
+        if (end == p || *end != ':')
+            goto invalid;
+        p = end + 1;
+        points[n_points].gain = strtod(p, &end) / 100.0;
+        if (end == p || (*end && *end != ','))
+            goto invalid;
+        n_points++;
+        if (*end == '\0')
+            break;
+    }
+    curve = curve_new_custom(points, n_points, full, max);
+    goto done;
+
+invalid:
+    errno = EINVAL;
+done:
+    free(points);
+    return curve;
+}
+
+void curve_free(struct curve *curve)
+{
+    if (!curve)
+        return;
+    free(curve->points);
+    free(curve->forward);
+    free(curve->inverse);
+    free(curve);
+}
+
+/* plain selects and no early exits, so the batch loops vectorize with
+ * the loads turned into gathers */
+static inline float forward_lookup(const float *f, uint32_t max, uint32_t volume)
+{
+    uint32_t v = volume < max ? volume : max;
+    /* the exact entries have nothing to interpolate. masks, not selects,
+     * which gcc turns back into branches here */
+    uint32_t exact = -(uint32_t)(v < CURVE_FORWARD_EXACT);
+    uint32_t i = (v & exact) | (((v >> CURVE_FORWARD_SHIFT) + FORWARD_OFFSET) & ~exact);
+    uint32_t m = v & (CURVE_FORWARD_STEP - 1) & ~exact;
+    float frac = (int32_t)m * (1.0f / CURVE_FORWARD_STEP);
+
+    return f[i] + (f[i + 1] - f[i]) * frac;
+}
+
+static inline uint32_t inverse_lookup(const float *inv, uint32_t base,
+    float max_gain, float full, float max, float gain)
+{
+    float g, frac, p;
+    uint32_t bits, i;
+
+    /* NaN fails both compares and ends up as silence */
+    g = gain > CURVE_MIN_GAIN ? gain : CURVE_MIN_GAIN;
+    g = g < max_gain ? g : max_gain;
+    bits = float_bits(g) - base;
+    i = bits >> INVERSE_SHIFT;
+    frac = (bits & INVERSE_MASK) * (1.0f / (INVERSE_MASK + 1));
+    p = (inv[i] + (inv[i + 1] - inv[i]) * frac) * full + 0.5f;
+
+    p = p > 0.5f ? p : 0.5f;
+    p = p < max ? p : max;
+    p = gain >= CURVE_MIN_GAIN ? p : 0.0f;
+    return (uint32_t)p;
+}
+
+float curve_to_linear(const struct curve *curve, uint32_t volume)
+{
+    return forward_lookup(curve->forward, curve->max, volume);
+}
+
+uint32_t curve_from_linear(const struct curve *curve, float gain)
+{
+    return inverse_lookup(curve->inverse, curve->inverse_base, curve->max_gain,
+        curve->full, curve->max, gain);
+}
+
+void curve_to_linear_n(const struct curve *curve,
+    const uint32_t *restrict volumes, float *restrict gains, uint32_t n)
+{
+    const float *f = curve->forward;
+    uint32_t max = curve->max;
+
+    for (uint32_t i = 0; i < n; i++)
+        gains[i] = forward_lookup(f, max, volumes[i]);
+}
+
+void curve_from_linear_n(const struct curve *curve,
+    const float *restrict gains, uint32_t *restrict volumes, uint32_t n)
+{
+    const float *inv = curve->inverse;
+    uint32_t base = curve->inverse_base;
+    float max_gain = curve->max_gain, full = curve->full, max = curve->max;
+
+    for (uint32_t i = 0; i < n; i++)
+        volumes[i] = inverse_lookup(inv, base, max_gain, full, max, gains[i]);
+}
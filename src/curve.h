@@ -0,0 +1,92 @@
+#ifndef PWMIXER_CURVE_H
+#define PWMIXER_CURVE_H
+
+#include <stdint.h>
+
+/* maps volume positions as the ui steps them to the linear gains the
+ * server takes and back. positions are integers from 0 to max with full
+ * for 100%; both directions are looked up in tables built once by
+ * curve_new*() and interpolated:
+ *
+ *   forward  one entry per position below CURVE_FORWARD_EXACT, where
+ *            cubic bends too much to interpolate, then one every
+ *            CURVE_FORWARD_STEP positions
+ *   inverse  indexed by the exponent and the top CURVE_INVERSE_BITS
+ *            mantissa bits of the gain, so the entries are spaced evenly
+ *            in each octave and steep curves stay accurate near 0 */
+
+#define CURVE_FORWARD_SHIFT 3
+#define CURVE_FORWARD_STEP  (1 << CURVE_FORWARD_SHIFT)
+#define CURVE_FORWARD_EXACT 32
+#define CURVE_INVERSE_BITS  7
+/* gains below are taken as silence; a curve must stay under the
+ * maximum up to its last position so every gain maps back */
+#define CURVE_MIN_GAIN      0x1p-40f
+#define CURVE_MAX_GAIN      0x1p20f
+#define CURVE_DB_FLOOR      -60.0f
+
+enum curve_type {
+    CURVE_LINEAR,
+    CURVE_CUBIC,
+    /* dB from floor_db at 0 to 0dB at full, 0 is silence. past full it
+     * rises as cubic does rather than another -floor_db per full */
+    CURVE_DB,
+    /* straight lines between points, continuing the last one */
+    CURVE_CUSTOM,
+};
+
+/* position 1.0 is full */
+struct curve_point {
+    float position;
+    float gain;
+};
+
+struct curve {
+    enum curve_type type;
+    uint32_t full;
+    uint32_t max;
+    float floor_db;
+    struct curve_point *points;
+    uint32_t n_points;
+
+    float *forward;
+    float *inverse;
+    uint32_t n_inverse;
+    uint32_t inverse_base;
+    float max_gain;
+};
+
+struct curve *curve_new(enum curve_type type, uint32_t full, uint32_t max);
+
+/* floor_db must be finite and below 0 */
+struct curve *curve_new_db(float floor_db, uint32_t full, uint32_t max);
+
+/* points must start at position 0 with positions rising and gains not
+ * falling, at least two of them */
+struct curve *curve_new_custom(const struct curve_point *points,
+    uint32_t n_points, uint32_t full, uint32_t max);
+
+/* linear, cubic, db (down to CURVE_DB_FLOOR), db:FLOOR or custom points as P:G,P:G,... in
+ * percent; NULL with errno set when str does not parse, ERANGE when the
+ * curve goes past CURVE_MAX_GAIN before max */
+struct curve *curve_parse(const char *str, uint32_t full, uint32_t max);
+
+void curve_free(struct curve *curve);
+
+/* the exact math the tables are built from */
+float curve_eval(const struct curve *curve, float position);
+
+float curve_invert(const struct curve *curve, float gain);
+
+float curve_to_linear(const struct curve *curve, uint32_t volume);
+
+uint32_t curve_from_linear(const struct curve *curve, float gain);
+
+/* the same over n channels in one branch-free loop */
+void curve_to_linear_n(const struct curve *curve,
+    const uint32_t *restrict volumes, float *restrict gains, uint32_t n);
+
+void curve_from_linear_n(const struct curve *curve,
+    const float *restrict gains, uint32_t *restrict volumes, uint32_t n);
+
+#endif
@@ -0,0 +1,106 @@
+#include <math.h>
+#include <stdint.h>
+#include "dsp.h"
+
+#ifdef DSP_X86
+#include <immintrin.h>
+#endif
+
+dsp_level_func_t dsp_level = dsp_level_c;
+
+void dsp_level_c(const float *samples, uint32_t n_samples,
+    float *peak, float *sum_sq)
+{
+    float p = *peak, s = *sum_sq, v;
+    uint32_t i;
+
+    for (i = 0; i < n_samples; i++) {
+        v = fabsf(samples[i]);
+        if (v > p)
+            p = v;
+        s += samples[i] * samples[i];
+    }
+    *peak = p;
+    *sum_sq = s;
+}
+
+#ifdef DSP_X86
+
+__attribute__((target("sse2")))
+void dsp_level_sse2(const float *samples, uint32_t n_samples,
+    float *peak, float *sum_sq)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 p0 = _mm_setzero_ps(), p1 = _mm_setzero_ps();
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    __m128 v0, v1;
+    float p[4], s[4];
+    uint32_t i = 0;
+
+    /* two accumulators hide the add latency */
+    for (; i + 8 <= n_samples; i += 8) {
+        v0 = _mm_loadu_ps(&samples[i]);
+        v1 = _mm_loadu_ps(&samples[i + 4]);
+        p0 = _mm_max_ps(p0, _mm_and_ps(v0, mask));
+        p1 = _mm_max_ps(p1, _mm_and_ps(v1, mask));
+        s0 = _mm_add_ps(s0, _mm_mul_ps(v0, v0));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(v1, v1));
+    }
+    _mm_storeu_ps(p, _mm_max_ps(p0, p1));
+    _mm_storeu_ps(s, _mm_add_ps(s0, s1));
+
+    *peak = fmaxf(*peak, fmaxf(fmaxf(p[0], p[1]), fmaxf(p[2], p[3])));
+    *sum_sq += (s[0] + s[1]) + (s[2] + s[3]);
+
+    dsp_level_c(&samples[i], n_samples - i, peak, sum_sq);
+}
+
+__attribute__((target("avx2")))
+void dsp_level_avx2(const float *samples, uint32_t n_samples,
+    float *peak, float *sum_sq)
+{
+    const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 p0 = _mm256_setzero_ps(), p1 = _mm256_setzero_ps();
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 v0, v1;
+    float p[8], s[8];
+    uint32_t i = 0, j;
+
+    for (; i + 16 <= n_samples; i += 16) {
+        v0 = _mm256_loadu_ps(&samples[i]);
+        v1 = _mm256_loadu_ps(&samples[i + 8]);
+        p0 = _mm256_max_ps(p0, _mm256_and_ps(v0, mask));
+        p1 = _mm256_max_ps(p1, _mm256_and_ps(v1, mask));
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(v0, v0));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(v1, v1));
+    }
+    _mm256_storeu_ps(p, _mm256_max_ps(p0, p1));
+    _mm256_storeu_ps(s, _mm256_add_ps(s0, s1));
+
+    for (j = 0; j < 8; j++) {
+        *peak = fmaxf(*peak, p[j]);
+        *sum_sq += s[j];
+    }
+
+    dsp_level_c(&samples[i], n_samples - i, peak, sum_sq);
+}
+
+#endif
+
+uint32_t dsp_init(void)
+{
+    uint32_t flags = 0;
+
+#ifdef DSP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        flags |= DSP_CPU_SSE2;
+        dsp_level = dsp_level_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        flags |= DSP_CPU_AVX2;
+        dsp_level = dsp_level_avx2;
+    }
+#endif
+    return flags;
+}
@@ -0,0 +1,38 @@
+#ifndef PWMIXER_DSP_H
+#define PWMIXER_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DSP_X86 1
+#endif
+
+enum dsp_cpu_flag {
+    DSP_CPU_SSE2 = 1 << 0,
+    DSP_CPU_AVX2 = 1 << 1,
+};
+
+/* folds n_samples into a running level: peak becomes the largest
+ * absolute sample seen so far and sum_sq accumulates the squares, the
+ * rms is sqrtf(sum_sq / total samples) */
+typedef void (*dsp_level_func_t)(const float *samples, uint32_t n_samples,
+    float *peak, float *sum_sq);
+
+void dsp_level_c(const float *samples, uint32_t n_samples,
+    float *peak, float *sum_sq);
+
+#ifdef DSP_X86
+void dsp_level_sse2(const float *samples, uint32_t n_samples,
+    float *peak, float *sum_sq);
+
+void dsp_level_avx2(const float *samples, uint32_t n_samples,
+    float *peak, float *sum_sq);
+#endif
+
+/* best kernel for this cpu, valid after dsp_init() */
+extern dsp_level_func_t dsp_level;
+
+uint32_t dsp_init(void);
+
+#endif
@@ -0,0 +1,160 @@
+#include <errno.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+
+#define INITIAL_CAP 4
+#define MAX_LINE 1024
+
+struct filter *filter_new(void)
+{
+    return calloc(1, sizeof(struct filter));
+}
+
+static struct filter_rule *add_rule(struct filter *filter)
+{
+    struct filter_rule *rules;
+    int capacity;
+
+    if (filter->length == filter->capacity) {
+        capacity = filter->capacity ? filter->capacity * 2 : INITIAL_CAP;
+        rules = realloc(filter->rules, capacity * sizeof(struct filter_rule));
+        if (!rules)
+            return NULL;
+        filter->rules = rules;
+        filter->capacity = capacity;
+    }
+    return memset(&filter->rules[filter->length], 0, sizeof(struct filter_rule));
+}
+
+int filter_add(struct filter *filter, const char *expr)
+{
+    struct filter_rule *rule;
+    const char *op;
+    size_t key_len;
+
+    if (!(rule = add_rule(filter)))
+        return -ENOMEM;
+
+    if (strcmp(expr, "hardware") == 0) {
+        rule->op = FILTER_HARDWARE;
+        filter->length++;
+        return 0;
+    }
+
+    if (!(op = strpbrk(expr, "=~!")))
+        return -EINVAL;
+    key_len = op - expr;
+    if (*op == '!') {
+        rule->negate = true;
+        op++;
+    }
+    if (*op == '=')
+        rule->op = FILTER_GLOB;
+    else if (*op == '~')
+        rule->op = FILTER_REGEX;
+    else
+        return -EINVAL;
+    if (key_len == 0)
+        return -EINVAL;
+
+    rule->key = strndup(expr, key_len);
+    rule->pattern = strdup(op + 1);
+    if (!rule->key || !rule->pattern)
+        goto error;
+    if (rule->op == FILTER_REGEX &&
+        regcomp(&rule->regex, rule->pattern, REG_EXTENDED | REG_NOSUB) != 0)
+    {
+        free(rule->key);
+        free(rule->pattern);
+        return -EINVAL;
+    }
+    filter->length++;
+    return 0;
+
+error:
+    free(rule->key);
+    free(rule->pattern);
+    return -ENOMEM;
+}
+
+int filter_load(struct filter *filter, const char *path, int *line)
+{
+    char buf[MAX_LINE], *start, *end;
+    FILE *file;
+    int res = 0;
+
+    *line = 0;
+    if (!(file = fopen(path, "r")))
+        return -errno;
+
+    while (fgets(buf, sizeof(buf), file)) {
+        (*line)++;
+        for (start = buf; isspace((unsigned char)*start); start++);
+        for (end = start + strlen(start); end > start && isspace((unsigned char)end[-1]); end--);
+        *end = '\0';
+        if (*start == '\0' || *start == '#')
+            continue;
+        if ((res = filter_add(filter, start)) < 0)
+            break;
+    }
+    if (res == 0 && ferror(file))
+        res = -EIO;
+    fclose(file);
+    return res;
+}
+
+static bool rule_match(const struct filter_rule *rule,
+    filter_lookup_t lookup, void *data)
+{
+    const char *value, *media_class;
+    bool match;
+
+    switch (rule->op) {
+    case FILTER_HARDWARE:
+        media_class = lookup(data, "media.class");
+        if (media_class && strncmp(media_class, "Stream/", 7) == 0)
+            return true;
+        return lookup(data, "device.id") != NULL;
+    case FILTER_GLOB:
+        value = lookup(data, rule->key);
+        match = value && fnmatch(rule->pattern, value, 0) == 0;
+        break;
+    case FILTER_REGEX:
+        value = lookup(data, rule->key);
+        match = value && regexec(&rule->regex, value, 0, NULL, 0) == 0;
+        break;
+    default:
+        return false;
+    }
+    return match != rule->negate;
+}
+
+bool filter_match(const struct filter *filter,
+    filter_lookup_t lookup, void *data)
+{
+    if (!filter)
+        return true;
+    for (int i = 0; i < filter->length; i++) {
+        if (!rule_match(&filter->rules[i], lookup, data))
+            return false;
+    }
+    return true;
+}
+
+void filter_free(struct filter *filter)
+{
+    if (!filter)
+        return;
+    for (int i = 0; i < filter->length; i++) {
+        if (filter->rules[i].op == FILTER_REGEX)
+            regfree(&filter->rules[i].regex);
+        free(filter->rules[i].key);
+        free(filter->rules[i].pattern);
+    }
+    free(filter->rules);
+    free(filter);
+}
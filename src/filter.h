@@ -0,0 +1,54 @@
+#ifndef PWMIXER_FILTER_H
+#define PWMIXER_FILTER_H
+
+#include <stdbool.h>
+#include <regex.h>
+
+/* expressions deciding which registry globals are worth binding, every
+ * rule has to hold for an object to be kept:
+ *
+ *   key=glob     property matches the fnmatch() pattern
+ *   key!=glob    property is missing or does not match
+ *   key~regex    property matches the extended regex
+ *   key!~regex   property is missing or does not match
+ *   hardware     sinks and sources must be backed by a device,
+ *                streams are always kept */
+
+enum filter_op {
+    FILTER_GLOB,
+    FILTER_REGEX,
+    FILTER_HARDWARE,
+};
+
+struct filter_rule {
+    enum filter_op op;
+    bool negate;
+    char *key;
+    char *pattern;
+    regex_t regex;
+};
+
+struct filter {
+    struct filter_rule *rules;
+    int length;
+    int capacity;
+};
+
+/* returns the value of key or NULL when the object does not have it */
+typedef const char *(*filter_lookup_t)(void *data, const char *key);
+
+struct filter *filter_new(void);
+
+/* returns -EINVAL for an expression that does not parse */
+int filter_add(struct filter *filter, const char *expr);
+
+/* one expression per line, blank lines and lines starting with # are
+ * skipped; on a bad expression -EINVAL is returned and line is set */
+int filter_load(struct filter *filter, const char *path, int *line);
+
+bool filter_match(const struct filter *filter,
+    filter_lookup_t lookup, void *data);
+
+void filter_free(struct filter *filter);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PWMIXER_HASH_H
+#define PWMIXER_HASH_H
+
+#include <stdint.h>
+
+/* helpers of the linear probing tables in map.c and intern.c */
+
+/* fnv-1a */
+static inline uint32_t hash_str(const char *key)
+{
+    uint32_t hash = 0x811C9DC5U;
+
+    while (*key) {
+        hash ^= (uint8_t)*key++;
+        hash *= 0x01000193U;
+    }
+    return hash;
+}
+
+/* true when an entry living at slot, which hashes to home, may be
+ * moved back into hole without breaking its probe sequence */
+static inline int in_probe_range(int home, int hole, int slot)
+{
+    if (hole <= slot)
+        return home <= hole || home > slot;
+    return home <= hole && home > slot;
+}
+
+#endif
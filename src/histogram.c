@@ -0,0 +1,63 @@
+#include <string.h>
+#include "histogram.h"
+
+uint32_t histogram_bucket(uint64_t value)
+{
+    uint32_t shift, bucket;
+
+    if (value < HISTOGRAM_SUB)
+        return value;
+
+    /* the top HISTOGRAM_SUB_SHIFT + 1 bits pick the bucket */
+    shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_SHIFT;
+    bucket = (shift + 1) * HISTOGRAM_SUB + (value >> shift) - HISTOGRAM_SUB;
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+uint64_t histogram_bucket_start(uint32_t bucket)
+{
+    uint32_t shift = bucket / HISTOGRAM_SUB;
+
+    if (shift == 0)
+        return bucket;
+    return (uint64_t)(HISTOGRAM_SUB + bucket % HISTOGRAM_SUB) << (shift - 1);
+}
+
+void histogram_record(struct histogram *hist, uint64_t value)
+{
+    __atomic_fetch_add(&hist->buckets[histogram_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    if (value > __atomic_load_n(&hist->max, __ATOMIC_RELAXED))
+        __atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+}
+
+uint64_t histogram_percentile(const struct histogram *hist, double fraction)
+{
+    uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    uint64_t rank, seen = 0, edge;
+    uint32_t i;
+
+    if (count == 0)
+        return 0;
+
+    rank = fraction <= 0 ? 1 : (uint64_t)(fraction * count + 0.999999);
+    if (rank > count)
+        rank = count;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+        seen += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank)
+            break;
+    }
+    if (i == HISTOGRAM_BUCKETS - 1)
+        return max;
+
+    edge = histogram_bucket_start(i + 1) - 1;
+    return edge < max ? edge : max;
+}
+
+void histogram_reset(struct histogram *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
@@ -0,0 +1,35 @@
+#ifndef PWMIXER_HISTOGRAM_H
+#define PWMIXER_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* latency histogram with HISTOGRAM_SUB buckets per power of two, so a
+ * percentile comes back within 1/HISTOGRAM_SUB of the value recorded.
+ * a zeroed histogram is empty; one thread records while any other may
+ * read, the counters are only ever touched with relaxed atomics */
+
+#define HISTOGRAM_SUB_SHIFT 3
+#define HISTOGRAM_SUB       (1 << HISTOGRAM_SUB_SHIFT)
+/* values below 2^40 get a bucket of their own, larger ones share the last */
+#define HISTOGRAM_BUCKETS   ((40 - HISTOGRAM_SUB_SHIFT + 1) * HISTOGRAM_SUB)
+
+struct histogram {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+uint32_t histogram_bucket(uint64_t value);
+
+/* smallest value falling into bucket */
+uint64_t histogram_bucket_start(uint32_t bucket);
+
+void histogram_record(struct histogram *hist, uint64_t value);
+
+/* upper edge of the bucket holding the given fraction of the values,
+ * never above the largest value recorded; 0 when empty */
+uint64_t histogram_percentile(const struct histogram *hist, double fraction);
+
+void histogram_reset(struct histogram *hist);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hash.h"
+#include "intern.h"
+
+#define INITIAL_CAP 64
+
+static struct intern_str *to_entry(const char *str)
+{
+    return (struct intern_str*)(str - offsetof(struct intern_str, str));
+}
+
+struct intern *intern_new(void)
+{
+    struct intern *intern = (struct intern*)malloc(sizeof(struct intern));
+    if (!intern) {
+        return NULL;
+    }
+
+    intern->entries = calloc(INITIAL_CAP, sizeof(struct intern_str*));
+    if (!intern->entries) {
+        free(intern);
+        return NULL;
+    }
+
+    intern->length = 0;
+    intern->capacity = INITIAL_CAP;
+    intern->bytes = INITIAL_CAP * sizeof(struct intern_str*);
+    return intern;
+}
+
+static int intern_slot(struct intern *intern, const char *str, uint32_t hash)
+{
+    int mask = intern->capacity - 1;
+    int i = hash & mask;
+
+    while (intern->entries[i] &&
+        (intern->entries[i]->hash != hash || strcmp(intern->entries[i]->str, str) != 0))
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int intern_grow(struct intern *intern)
+{
+    struct intern_str **old = intern->entries;
+    int i, n = intern->capacity;
+
+    intern->entries = calloc(n * 2, sizeof(struct intern_str*));
+    if (!intern->entries) {
+        intern->entries = old;
+        return -1;
+    }
+    intern->capacity = n * 2;
+    intern->bytes += n * sizeof(struct intern_str*);
+
+    for (i = 0; i < n; i++) {
+        if (old[i])
+            intern->entries[intern_slot(intern, old[i]->str, old[i]->hash)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+const char *intern_get(struct intern *intern, const char *str)
+{
+    struct intern_str *entry;
+    uint32_t hash;
+    size_t len;
+    int i;
+
+    if (!str)
+        return NULL;
+
+    hash = hash_str(str);
+    i = intern_slot(intern, str, hash);
+    if ((entry = intern->entries[i]) != NULL) {
+        entry->refs++;
+        return entry->str;
+    }
+
+    if ((intern->length + 1) * 4 > intern->capacity * 3) {
+        if (intern_grow(intern) < 0)
+            return NULL;
+        i = intern_slot(intern, str, hash);
+    }
+
+    len = strlen(str) + 1;
+    if (!(entry = malloc(sizeof(struct intern_str) + len)))
+        return NULL;
+    entry->hash = hash;
+    entry->refs = 1;
+    memcpy(entry->str, str, len);
+
+    intern->entries[i] = entry;
+    intern->length++;
+    intern->bytes += sizeof(struct intern_str) + len;
+    return entry->str;
+}
+
+void intern_put(struct intern *intern, const char *str)
+{
+    struct intern_str *entry;
+    int mask = intern->capacity - 1, hole, slot, home;
+
+    if (!str)
+        return;
+    entry = to_entry(str);
+    if (--entry->refs > 0)
+        return;
+
+    /* find the slot by identity, then close the gap behind it */
+    for (hole = entry->hash & mask; intern->entries[hole] != entry; hole = (hole + 1) & mask);
+    for (slot = (hole + 1) & mask; intern->entries[slot]; slot = (slot + 1) & mask) {
+        home = intern->entries[slot]->hash & mask;
+        if (in_probe_range(home, hole, slot)) {
+            intern->entries[hole] = intern->entries[slot];
+            hole = slot;
+        }
+    }
+    intern->entries[hole] = NULL;
+    intern->length--;
+    intern->bytes -= sizeof(struct intern_str) + strlen(entry->str) + 1;
+    free(entry);
+}
+
+int intern_free(struct intern *intern)
+{
+    int i;
+
+    if (!intern)
+        return 0;
+    for (i = 0; i < intern->capacity; i++)
+        free(intern->entries[i]);
+    free(intern->entries);
+    free(intern);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef PWMIXER_INTERN_H
+#define PWMIXER_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* reference counted table of unique strings, equal property values of
+ * many objects share one copy and can be compared by pointer */
+
+struct intern_str {
+    uint32_t hash;
+    uint32_t refs;
+    char str[];
+};
+
+struct intern {
+    struct intern_str **entries;
+    int length;
+    int capacity;
+    size_t bytes;
+};
+
+struct intern *intern_new(void);
+
+/* returns the shared copy of str with a reference taken, NULL when str
+ * is NULL or out of memory */
+const char *intern_get(struct intern *intern, const char *str);
+
+/* drops a reference taken by intern_get, NULL is ignored */
+void intern_put(struct intern *intern, const char *str);
+
+int intern_free(struct intern *intern);
+
+#endif
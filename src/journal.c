@@ -0,0 +1,261 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "journal.h"
+
+#define INITIAL_CAP 1024
+#define FILE_BUFFER 65536
+#define NULL_STR 0xffffffffU
+#define MAX_RECORD (16 * 1024 * 1024)
+
+static const char magic[8] = { 'P', 'W', 'M', 'X', 'J', 'R', 'N', 'L' };
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+};
+
+static uint32_t pad8(uint32_t size)
+{
+    return (size + 7) & ~7U;
+}
+
+struct journal *journal_open(const char *path, bool write)
+{
+    struct file_header header;
+    struct journal *journal = calloc(1, sizeof(struct journal));
+    if (!journal) {
+        return NULL;
+    }
+
+    journal->write = write;
+    journal->data = malloc(INITIAL_CAP);
+    journal->capacity = INITIAL_CAP;
+    journal->file = fopen(path, write ? "wb" : "rb");
+    if (!journal->data || !journal->file)
+        goto error;
+
+    /* records are written from event callbacks, keep them off the
+     * disk until a good chunk has built up */
+    setvbuf(journal->file, NULL, _IOFBF, FILE_BUFFER);
+
+    if (write) {
+        memcpy(header.magic, magic, sizeof(magic));
+        header.version = JOURNAL_VERSION;
+        header.flags = 0;
+        if (fwrite(&header, sizeof(header), 1, journal->file) != 1)
+            goto error;
+    } else {
+        if (fread(&header, sizeof(header), 1, journal->file) != 1 ||
+            memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+            header.version != JOURNAL_VERSION)
+        {
+            errno = EINVAL;
+            goto error;
+        }
+    }
+    return journal;
+
+error:
+    if (journal->file)
+        fclose(journal->file);
+    free(journal->data);
+    free(journal);
+    return NULL;
+}
+
+int journal_close(struct journal *journal)
+{
+    int res = 0;
+
+    if (!journal)
+        return 0;
+    if (fclose(journal->file) != 0 || journal->error)
+        res = -EIO;
+    free(journal->data);
+    free(journal);
+    return res;
+}
+
+static int reserve(struct journal *journal, uint32_t size)
+{
+    uint32_t capacity = journal->capacity;
+    uint8_t *data;
+
+    if (journal->size + size <= capacity)
+        return 0;
+    while (journal->size + size > capacity)
+        capacity *= 2;
+    if (!(data = realloc(journal->data, capacity))) {
+        journal->error = true;
+        return -ENOMEM;
+    }
+    journal->data = data;
+    journal->capacity = capacity;
+    return 0;
+}
+
+static int put(struct journal *journal, const void *data, uint32_t size)
+{
+    if (reserve(journal, size) < 0)
+        return -ENOMEM;
+    memcpy(journal->data + journal->size, data, size);
+    journal->size += size;
+    return 0;
+}
+
+int journal_begin(struct journal *journal, uint32_t type, uint64_t time)
+{
+    journal->record.type = type;
+    journal->record.time = time;
+    journal->size = 0;
+    return 0;
+}
+
+int journal_put_u32(struct journal *journal, uint32_t value)
+{
+    return put(journal, &value, sizeof(value));
+}
+
+int journal_put_u64(struct journal *journal, uint64_t value)
+{
+    return put(journal, &value, sizeof(value));
+}
+
+int journal_put_str(struct journal *journal, const char *str)
+{
+    uint32_t len;
+
+    if (str == NULL)
+        return journal_put_u32(journal, NULL_STR);
+    len = strlen(str);
+    if (journal_put_u32(journal, len) < 0)
+        return -ENOMEM;
+    return put(journal, str, len + 1);
+}
+
+int journal_put_data(struct journal *journal, const void *data, uint32_t size)
+{
+    uint32_t offset;
+
+    if (journal_put_u32(journal, size) < 0)
+        return -ENOMEM;
+    offset = pad8(journal->size);
+    if (reserve(journal, offset - journal->size + size) < 0)
+        return -ENOMEM;
+    memset(journal->data + journal->size, 0, offset - journal->size);
+    journal->size = offset;
+    return put(journal, data, size);
+}
+
+int journal_end(struct journal *journal)
+{
+    static const uint8_t zero[8];
+    uint32_t padded = pad8(journal->size);
+
+    journal->record.size = journal->size;
+    if (fwrite(&journal->record, sizeof(journal->record), 1, journal->file) != 1 ||
+        fwrite(journal->data, 1, journal->size, journal->file) != journal->size ||
+        fwrite(zero, 1, padded - journal->size, journal->file) != padded - journal->size)
+    {
+        journal->error = true;
+        return -EIO;
+    }
+    journal->n_records++;
+    return 0;
+}
+
+int journal_read(struct journal *journal, struct journal_record *record)
+{
+    uint32_t padded;
+
+    if (journal->unread) {
+        journal->unread = false;
+        journal->pos = 0;
+        *record = journal->record;
+        return 1;
+    }
+
+    if (fread(&journal->record, sizeof(journal->record), 1, journal->file) != 1)
+        return feof(journal->file) ? 0 : -EIO;
+
+    if (journal->record.size > MAX_RECORD)
+        return -EINVAL;
+    padded = pad8(journal->record.size);
+    journal->size = 0;
+    if (reserve(journal, padded) < 0)
+        return -ENOMEM;
+    if (fread(journal->data, 1, padded, journal->file) != padded)
+        return -EINVAL;
+
+    journal->size = journal->record.size;
+    journal->pos = 0;
+    journal->n_records++;
+    *record = journal->record;
+    return 1;
+}
+
+void journal_unread(struct journal *journal)
+{
+    journal->unread = true;
+}
+
+int journal_peek(struct journal *journal, struct journal_record *record)
+{
+    int res = journal_read(journal, record);
+    if (res > 0)
+        journal_unread(journal);
+    return res;
+}
+
+static int get(struct journal *journal, void *data, uint32_t size)
+{
+    if (journal->size - journal->pos < size)
+        return -EINVAL;
+    memcpy(data, journal->data + journal->pos, size);
+    journal->pos += size;
+    return 0;
+}
+
+int journal_get_u32(struct journal *journal, uint32_t *value)
+{
+    return get(journal, value, sizeof(*value));
+}
+
+int journal_get_u64(struct journal *journal, uint64_t *value)
+{
+    return get(journal, value, sizeof(*value));
+}
+
+int journal_get_str(struct journal *journal, const char **str)
+{
+    uint32_t len;
+
+    if (journal_get_u32(journal, &len) < 0)
+        return -EINVAL;
+    if (len == NULL_STR) {
+        *str = NULL;
+        return 0;
+    }
+    if (journal->size - journal->pos < len + 1 ||
+        journal->data[journal->pos + len] != '\0')
+        return -EINVAL;
+    *str = (const char*)journal->data + journal->pos;
+    journal->pos += len + 1;
+    return 0;
+}
+
+int journal_get_data(struct journal *journal, const void **data, uint32_t *size)
+{
+    uint32_t offset;
+
+    if (journal_get_u32(journal, size) < 0)
+        return -EINVAL;
+    offset = pad8(journal->pos);
+    if (offset > journal->size || journal->size - offset < *size)
+        return -EINVAL;
+    *data = journal->data + offset;
+    journal->pos = offset + *size;
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef PWMIXER_JOURNAL_H
+#define PWMIXER_JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* append-only binary log of timestamped records, each record is a type,
+ * a payload size and a time followed by the payload padded to 8 bytes;
+ * values are stored in host byte order */
+
+#define JOURNAL_VERSION 1
+
+struct journal_record {
+    uint32_t type;
+    uint32_t size;
+    uint64_t time;
+};
+
+struct journal {
+    FILE *file;
+    bool write;
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t pos;
+    struct journal_record record;
+    bool unread;
+    bool error;
+    uint64_t n_records;
+};
+
+struct journal *journal_open(const char *path, bool write);
+
+int journal_close(struct journal *journal);
+
+int journal_begin(struct journal *journal, uint32_t type, uint64_t time);
+
+int journal_put_u32(struct journal *journal, uint32_t value);
+
+int journal_put_u64(struct journal *journal, uint64_t value);
+
+/* NULL is kept apart from the empty string */
+int journal_put_str(struct journal *journal, const char *str);
+
+/* data is aligned to 8 bytes in the payload */
+int journal_put_data(struct journal *journal, const void *data, uint32_t size);
+
+int journal_end(struct journal *journal);
+
+/* returns 1 with the next record loaded, 0 at the end of the journal or
+ * a negative errno for a truncated or corrupt journal */
+int journal_read(struct journal *journal, struct journal_record *record);
+
+/* hand the record just read out again on the next journal_read */
+void journal_unread(struct journal *journal);
+
+int journal_peek(struct journal *journal, struct journal_record *record);
+
+int journal_get_u32(struct journal *journal, uint32_t *value);
+
+int journal_get_u64(struct journal *journal, uint64_t *value);
+
+/* str points into the record and is valid until the next journal_read */
+int journal_get_str(struct journal *journal, const char **str);
+
+int journal_get_data(struct journal *journal, const void **data, uint32_t *size);
+
+#endif
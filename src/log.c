@@ -0,0 +1,533 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "log.h"
+
+#define WRITE_BUFFER 65536
+#define FLUSH_INTERVAL_MS 50
+
+int log_level = LOG_LEVEL_NONE;
+
+static const char *const level_names[] = {
+    "none", "error", "warn", "info", "debug", "trace",
+};
+
+static struct {
+    struct log_ring ring;
+    pthread_t thread;
+    int running;
+    int fd;
+    uint64_t start;
+    uint64_t dropped;
+} logger = { .fd = -1 };
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** ring */
+
+int log_ring_init(struct log_ring *ring, uint32_t size)
+{
+    uint32_t i, n = 2;
+
+    while (n < size)
+        n <<= 1;
+
+    ring->cells = calloc(n, sizeof(struct log_cell));
+    if (!ring->cells)
+        return -1;
+    for (i = 0; i < n; i++)
+        ring->cells[i].seq = i;
+
+    ring->mask = n - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    return 0;
+}
+
+void log_ring_clear(struct log_ring *ring)
+{
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+int log_ring_push(struct log_ring *ring, const struct log_record *record)
+{
+    struct log_cell *cell;
+    uint64_t pos, seq;
+    int64_t diff;
+
+    /* each cell carries the position it is free for, a producer claims
+     * it by advancing head and publishes it by bumping seq */
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->record = *record;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int log_ring_pop(struct log_ring *ring, struct log_record *record)
+{
+    struct log_cell *cell = &ring->cells[ring->tail & ring->mask];
+
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != ring->tail + 1)
+        return -1;
+
+    *record = cell->record;
+    __atomic_store_n(&cell->seq, ring->tail + ring->mask + 1, __ATOMIC_RELEASE);
+    ring->tail++;
+    return 0;
+}
+
+/** records */
+
+struct spec {
+    const char *start;
+    const char *end;
+    char conv;
+    int length;
+    int n_star;
+};
+
+enum {
+    LEN_NONE,
+    LEN_HH,
+    LEN_H,
+    LEN_L,
+    LEN_LL,
+    LEN_J,
+    LEN_Z,
+    LEN_T,
+    LEN_BIG_L,
+};
+
+/* parse one conversion starting at the '%', returns NULL at the end of
+ * the format or on a conversion that cannot be captured */
+static const char *parse_spec(const char *p, struct spec *spec)
+{
+    spec->start = p++;
+    spec->length = LEN_NONE;
+    spec->n_star = 0;
+
+    while (*p && strchr("-+ #0'", *p))
+        p++;
+    if (*p == '*') {
+        spec->n_star++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9')
+        p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->n_star++;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+
+    switch (*p) {
+    case 'h':
+        spec->length = p[1] == 'h' ? LEN_HH : LEN_H;
+        p += spec->length == LEN_HH ? 2 : 1;
+        break;
+    case 'l':
+        spec->length = p[1] == 'l' ? LEN_LL : LEN_L;
+        p += spec->length == LEN_LL ? 2 : 1;
+        break;
+    case 'j': spec->length = LEN_J; p++; break;
+    case 'z': spec->length = LEN_Z; p++; break;
+    case 't': spec->length = LEN_T; p++; break;
+    case 'L': spec->length = LEN_BIG_L; p++; break;
+    }
+
+    if (!*p || !strchr("diouxXcfFeEgGaAsp%", *p))
+        return NULL;
+    spec->conv = *p++;
+    spec->end = p;
+    return p;
+}
+
+static int64_t arg_signed(int length, va_list *args)
+{
+    switch (length) {
+    case LEN_HH: return (signed char)va_arg(*args, int);
+    case LEN_H: return (short)va_arg(*args, int);
+    case LEN_L: return va_arg(*args, long);
+    case LEN_LL: return va_arg(*args, long long);
+    case LEN_J: return va_arg(*args, intmax_t);
+    case LEN_Z: return va_arg(*args, ssize_t);
+    case LEN_T: return va_arg(*args, ptrdiff_t);
+    default: return va_arg(*args, int);
+    }
+}
+
+static uint64_t arg_unsigned(int length, va_list *args)
+{
+    switch (length) {
+    case LEN_HH: return (unsigned char)va_arg(*args, unsigned int);
+    case LEN_H: return (unsigned short)va_arg(*args, unsigned int);
+    case LEN_L: return va_arg(*args, unsigned long);
+    case LEN_LL: return va_arg(*args, unsigned long long);
+    case LEN_J: return va_arg(*args, uintmax_t);
+    case LEN_Z: return va_arg(*args, size_t);
+    case LEN_T: return va_arg(*args, ptrdiff_t);
+    default: return va_arg(*args, unsigned int);
+    }
+}
+
+int log_record_capture(struct log_record *record, enum log_level level,
+    const char *format, va_list args)
+{
+    struct spec spec;
+    const char *p = format, *s;
+    uint32_t n = 0, used = 0, len;
+    va_list ap;
+    int i;
+
+    record->time = now_ns();
+    record->level = level;
+    record->format = format;
+
+    /* va_list may be an array type, walk a copy through a pointer so the
+     * helpers can consume from it */
+    va_copy(ap, args);
+    while ((p = strchr(p, '%')) != NULL) {
+        if (!(p = parse_spec(p, &spec)) ||
+            n + spec.n_star + 1 > LOG_MAX_ARGS) {
+            va_end(ap);
+            record->n_args = n;
+            return -1;
+        }
+        if (spec.conv == '%')
+            continue;
+
+        for (i = 0; i < spec.n_star; i++)
+            record->args[n++].i = va_arg(ap, int);
+
+        switch (spec.conv) {
+        case 'd': case 'i':
+            record->args[n++].i = arg_signed(spec.length, &ap);
+            break;
+        case 'o': case 'u': case 'x': case 'X': case 'c':
+            record->args[n++].u = arg_unsigned(spec.length, &ap);
+            break;
+        case 's':
+            s = va_arg(ap, const char *);
+            if (!s)
+                s = "(null)";
+            len = strnlen(s, LOG_STR_SIZE - 1 - used);
+            memcpy(record->str + used, s, len);
+            record->str[used + len] = '\0';
+            record->args[n++].str = used;
+            used += len < LOG_STR_SIZE - 1 - used ? len + 1 : len;
+            break;
+        case 'p':
+            record->args[n++].p = va_arg(ap, const void *);
+            break;
+        default:
+            if (spec.length == LEN_BIG_L)
+                record->args[n++].d = (double)va_arg(ap, long double);
+            else
+                record->args[n++].d = va_arg(ap, double);
+            break;
+        }
+    }
+    va_end(ap);
+    record->n_args = n;
+    return 0;
+}
+
+/* rebuild a conversion with the captured widths spelled out and the
+ * length modifier normalized to the type the argument was stored as */
+static void build_spec(const struct spec *spec, const union log_arg *stars,
+    const char *length, char *out, size_t size)
+{
+    const char *p;
+    size_t n = 0;
+    int star = 0;
+
+    for (p = spec->start; p < spec->end - 1 && n + 12 < size; p++) {
+        if (*p == '*')
+            n += snprintf(out + n, size - n, "%d", (int)stars[star++].i);
+        else if (!strchr("hljztL", *p))
+            out[n++] = *p;
+    }
+    snprintf(out + n, size - n, "%s%c", length, spec->end[-1]);
+}
+
+int log_record_format(const struct log_record *record, char *buf, size_t size)
+{
+    struct spec spec;
+    const union log_arg *arg = record->args;
+    const char *p = record->format, *q;
+    char fmt[64];
+    size_t n = 0;
+    int r;
+
+#define APPEND(...) do {                                        \
+        r = snprintf(buf + n, n < size ? size - n : 0, __VA_ARGS__); \
+        if (r > 0)                                              \
+            n += r;                                             \
+    } while (0)
+
+    while (*p) {
+        if (!(q = strchr(p, '%')))
+            q = p + strlen(p);
+        APPEND("%.*s", (int)(q - p), p);
+        if (!*q)
+            break;
+        if (!(p = parse_spec(q, &spec))) {
+            APPEND("%s", q);
+            break;
+        }
+        if (spec.conv == '%') {
+            APPEND("%%");
+            continue;
+        }
+        if (arg + spec.n_star >= record->args + record->n_args)
+            break;
+
+        switch (spec.conv) {
+        case 'd': case 'i':
+            build_spec(&spec, arg, "ll", fmt, sizeof(fmt));
+            arg += spec.n_star;
+            APPEND(fmt, (long long)arg->i);
+            break;
+        case 'o': case 'u': case 'x': case 'X':
+            build_spec(&spec, arg, "ll", fmt, sizeof(fmt));
+            arg += spec.n_star;
+            APPEND(fmt, (unsigned long long)arg->u);
+            break;
+        case 'c':
+            build_spec(&spec, arg, "", fmt, sizeof(fmt));
+            arg += spec.n_star;
+            APPEND(fmt, (int)arg->u);
+            break;
+        case 's':
+            build_spec(&spec, arg, "", fmt, sizeof(fmt));
+            arg += spec.n_star;
+            APPEND(fmt, record->str + arg->str);
+            break;
+        case 'p':
+            build_spec(&spec, arg, "", fmt, sizeof(fmt));
+            arg += spec.n_star;
+            APPEND(fmt, arg->p);
+            break;
+        default:
+            build_spec(&spec, arg, "", fmt, sizeof(fmt));
+            arg += spec.n_star;
+            APPEND(fmt, arg->d);
+            break;
+        }
+        arg++;
+    }
+#undef APPEND
+
+    if (size > 0 && n >= size)
+        n = size - 1;
+    return n;
+}
+
+/** writer */
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t r;
+
+    while (len > 0) {
+        r = write(fd, buf, len);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buf += r;
+        len -= r;
+    }
+}
+
+/* format everything queued into buf, writing it out in large chunks,
+ * returns the number of records consumed */
+static int drain(char *buf, uint64_t *reported)
+{
+    struct log_record record;
+    uint64_t t, dropped;
+    size_t n = 0;
+    int count = 0, r;
+
+    while (log_ring_pop(&logger.ring, &record) == 0) {
+        if (n + LOG_STR_SIZE * 4 > WRITE_BUFFER) {
+            write_all(logger.fd, buf, n);
+            n = 0;
+        }
+        t = record.time - logger.start;
+        n += snprintf(buf + n, WRITE_BUFFER - n, "[%5u.%06u] %-5s ",
+                (unsigned)(t / 1000000000ULL), (unsigned)(t / 1000 % 1000000),
+                level_names[record.level]);
+        r = log_record_format(&record, buf + n, WRITE_BUFFER - n - 1);
+        n += r;
+        buf[n++] = '\n';
+        count++;
+    }
+
+    dropped = __atomic_load_n(&logger.dropped, __ATOMIC_RELAXED);
+    if (dropped != *reported) {
+        if (n + 64 > WRITE_BUFFER) {
+            write_all(logger.fd, buf, n);
+            n = 0;
+        }
+        n += snprintf(buf + n, WRITE_BUFFER - n,
+                "log: %llu records dropped\n",
+                (unsigned long long)(dropped - *reported));
+        *reported = dropped;
+    }
+    if (n > 0)
+        write_all(logger.fd, buf, n);
+    return count;
+}
+
+static void *writer_thread(void *data)
+{
+    struct timespec interval = {
+        .tv_sec = 0,
+        .tv_nsec = FLUSH_INTERVAL_MS * 1000000L,
+    };
+    uint64_t reported = 0;
+    char *buf = data;
+
+    while (__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE)) {
+        if (drain(buf, &reported) == 0)
+            nanosleep(&interval, NULL);
+    }
+    drain(buf, &reported);
+    /* handed back to log_deinit() to free once joined */
+    return buf;
+}
+
+int log_init(const char *path, enum log_level level, uint32_t n_records)
+{
+    char *buf;
+
+    if (!path || level == LOG_LEVEL_NONE)
+        return 0;
+
+    logger.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (logger.fd < 0)
+        return -1;
+
+    if (log_ring_init(&logger.ring, n_records) < 0)
+        goto error_close;
+    if (!(buf = malloc(WRITE_BUFFER)))
+        goto error_ring;
+
+    logger.start = now_ns();
+    logger.dropped = 0;
+    logger.running = 1;
+    if (pthread_create(&logger.thread, NULL, writer_thread, buf) != 0)
+        goto error_buf;
+
+    log_set_level(level);
+    return 0;
+
+error_buf:
+    free(buf);
+error_ring:
+    log_ring_clear(&logger.ring);
+error_close:
+    close(logger.fd);
+    logger.fd = -1;
+    return -1;
+}
+
+void log_deinit(void)
+{
+    void *buf;
+
+    if (logger.fd < 0)
+        return;
+
+    /* callers must have stopped their own threads by now, the ring goes
+     * away with the writer */
+    log_set_level(LOG_LEVEL_NONE);
+    __atomic_store_n(&logger.running, 0, __ATOMIC_RELEASE);
+    pthread_join(logger.thread, &buf);
+    free(buf);
+
+    log_ring_clear(&logger.ring);
+    close(logger.fd);
+    logger.fd = -1;
+}
+
+void log_set_level(enum log_level level)
+{
+    /* without a writer there is nowhere for records to go */
+    if (logger.fd < 0)
+        level = LOG_LEVEL_NONE;
+    __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+}
+
+int log_parse_level(const char *str)
+{
+    char *end;
+    long l;
+    int i;
+
+    for (i = LOG_LEVEL_NONE; i <= LOG_LEVEL_TRACE; i++) {
+        if (strcasecmp(str, level_names[i]) == 0)
+            return i;
+    }
+    l = strtol(str, &end, 10);
+    if (*str && !*end && l >= LOG_LEVEL_NONE && l <= LOG_LEVEL_TRACE)
+        return l;
+    return -1;
+}
+
+uint64_t log_dropped(void)
+{
+    return __atomic_load_n(&logger.dropped, __ATOMIC_RELAXED);
+}
+
+void log_write(enum log_level level, const char *format, ...)
+{
+    struct log_record record;
+    va_list args;
+    int res;
+
+    if (!log_enabled(level) || level == LOG_LEVEL_NONE)
+        return;
+
+    /* a format the record cannot hold counts as dropped, a partial
+     * record would print the wrong arguments */
+    va_start(args, format);
+    res = log_record_capture(&record, level, format, args);
+    va_end(args);
+
+    if (res < 0 || log_ring_push(&logger.ring, &record) < 0)
+        __atomic_fetch_add(&logger.dropped, 1, __ATOMIC_RELAXED);
+}
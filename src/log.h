@@ -0,0 +1,98 @@
+#ifndef PWMIXER_LOG_H
+#define PWMIXER_LOG_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_MAX_ARGS 8
+#define LOG_STR_SIZE 128
+
+enum log_level {
+    LOG_LEVEL_NONE,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_TRACE,
+};
+
+union log_arg {
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void *p;
+    uint32_t str;
+};
+
+/* a log call captured in binary form, the format string must be a
+ * literal since only its address is kept; string arguments are copied
+ * into str and truncated when they do not fit */
+struct log_record {
+    uint64_t time;
+    uint32_t level;
+    uint32_t n_args;
+    const char *format;
+    union log_arg args[LOG_MAX_ARGS];
+    char str[LOG_STR_SIZE];
+};
+
+struct log_cell {
+    uint64_t seq;
+    struct log_record record;
+};
+
+/* bounded multi-producer single-consumer queue, producers never block
+ * and a full ring drops the record */
+struct log_ring {
+    struct log_cell *cells;
+    uint32_t mask;
+    uint64_t head;
+    uint64_t tail;
+};
+
+int log_ring_init(struct log_ring *ring, uint32_t size);
+
+void log_ring_clear(struct log_ring *ring);
+
+int log_ring_push(struct log_ring *ring, const struct log_record *record);
+
+int log_ring_pop(struct log_ring *ring, struct log_record *record);
+
+int log_record_capture(struct log_record *record, enum log_level level,
+    const char *format, va_list args);
+
+int log_record_format(const struct log_record *record, char *buf, size_t size);
+
+/* the writer thread owns the file, log calls only enqueue records */
+int log_init(const char *path, enum log_level level, uint32_t n_records);
+
+void log_deinit(void);
+
+void log_set_level(enum log_level level);
+
+int log_parse_level(const char *str);
+
+uint64_t log_dropped(void);
+
+void log_write(enum log_level level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+extern int log_level;
+
+#define log_enabled(lvl) (__atomic_load_n(&log_level, __ATOMIC_RELAXED) >= (int)(lvl))
+
+#define log_at(lvl, ...)                    \
+    do {                                    \
+        if (log_enabled(lvl))               \
+            log_write(lvl, __VA_ARGS__);    \
+    } while (0)
+
+#define log_error(...) log_at(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_warn(...)  log_at(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_info(...)  log_at(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_trace(...) log_at(LOG_LEVEL_TRACE, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hash.h"
+#include "map.h"
+
+#define INITIAL_CAP 16
+
+static uint32_t hash_id(uint32_t key)
+{
+    /* fibonacci hashing spreads the mostly sequential registry ids */
+    return key * 0x9E3779B1U;
+}
+
+/** idmap */
+
+struct idmap *idmap_new(void)
+{
+    struct idmap *map = (struct idmap*)malloc(sizeof(struct idmap));
+    if (!map) {
+        return NULL;
+    }
+
+    map->entries = calloc(INITIAL_CAP, sizeof(struct idmap_entry));
+    if (!map->entries) {
+        free(map);
+        return NULL;
+    }
+
+    map->length = 0;
+    map->capacity = INITIAL_CAP;
+    return map;
+}
+
+static int idmap_slot(struct idmap *map, uint32_t key)
+{
+    int mask = map->capacity - 1;
+    int i = hash_id(key) & mask;
+
+    while (map->entries[i].item && map->entries[i].key != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int idmap_grow(struct idmap *map)
+{
+    struct idmap_entry *old = map->entries;
+    int i, n = map->capacity;
+
+    map->entries = calloc(n * 2, sizeof(struct idmap_entry));
+    if (!map->entries) {
+        map->entries = old;
+        return -1;
+    }
+    map->capacity = n * 2;
+
+    for (i = 0; i < n; i++) {
+        if (old[i].item)
+            map->entries[idmap_slot(map, old[i].key)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+int idmap_put(struct idmap *map, uint32_t key, void *item)
+{
+    int i;
+
+    if (!item)
+        return -1;
+    if ((map->length + 1) * 4 > map->capacity * 3 && idmap_grow(map) < 0)
+        return -1;
+
+    i = idmap_slot(map, key);
+    if (!map->entries[i].item)
+        map->length++;
+    map->entries[i].key = key;
+    map->entries[i].item = item;
+    return map->length;
+}
+
+void *idmap_get(struct idmap *map, uint32_t key)
+{
+    return map->entries[idmap_slot(map, key)].item;
+}
+
+int idmap_remove(struct idmap *map, uint32_t key, void *item)
+{
+    int mask = map->capacity - 1;
+    int hole = idmap_slot(map, key), slot, home;
+
+    if (!map->entries[hole].item ||
+        (item && map->entries[hole].item != item))
+        return -1;
+
+    for (slot = (hole + 1) & mask; map->entries[slot].item; slot = (slot + 1) & mask) {
+        home = hash_id(map->entries[slot].key) & mask;
+        if (in_probe_range(home, hole, slot)) {
+            map->entries[hole] = map->entries[slot];
+            hole = slot;
+        }
+    }
+    map->entries[hole].item = NULL;
+    map->length--;
+    return map->length;
+}
+
+int idmap_free(struct idmap *map)
+{
+    if (!map)
+        return 0;
+    free(map->entries);
+    free(map);
+    return 0;
+}
+
+/** strmap */
+
+struct strmap *strmap_new(void)
+{
+    struct strmap *map = (struct strmap*)malloc(sizeof(struct strmap));
+    if (!map) {
+        return NULL;
+    }
+
+    map->entries = calloc(INITIAL_CAP, sizeof(struct strmap_entry));
+    if (!map->entries) {
+        free(map);
+        return NULL;
+    }
+
+    map->length = 0;
+    map->capacity = INITIAL_CAP;
+    return map;
+}
+
+static int strmap_slot(struct strmap *map, const char *key, uint32_t hash)
+{
+    int mask = map->capacity - 1;
+    int i = hash & mask;
+
+    while (map->entries[i].key &&
+        (map->entries[i].hash != hash || strcmp(map->entries[i].key, key) != 0))
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int strmap_grow(struct strmap *map)
+{
+    struct strmap_entry *old = map->entries;
+    int i, n = map->capacity;
+
+    map->entries = calloc(n * 2, sizeof(struct strmap_entry));
+    if (!map->entries) {
+        map->entries = old;
+        return -1;
+    }
+    map->capacity = n * 2;
+
+    for (i = 0; i < n; i++) {
+        if (old[i].key)
+            map->entries[strmap_slot(map, old[i].key, old[i].hash)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+int strmap_put(struct strmap *map, const char *key, void *item)
+{
+    uint32_t hash;
+    int i;
+
+    if (!key || !item)
+        return -1;
+    if ((map->length + 1) * 4 > map->capacity * 3 && strmap_grow(map) < 0)
+        return -1;
+
+    hash = hash_str(key);
+    i = strmap_slot(map, key, hash);
+    if (!map->entries[i].key) {
+        if (!(map->entries[i].key = strdup(key)))
+            return -1;
+        map->entries[i].hash = hash;
+        map->length++;
+    }
+    map->entries[i].item = item;
+    return map->length;
+}
+
+void *strmap_get(struct strmap *map, const char *key)
+{
+    int i = strmap_slot(map, key, hash_str(key));
+    return map->entries[i].key ? map->entries[i].item : NULL;
+}
+
+int strmap_remove(struct strmap *map, const char *key, void *item)
+{
+    int mask = map->capacity - 1;
+    int hole = strmap_slot(map, key, hash_str(key)), slot, home;
+
+    if (!map->entries[hole].key ||
+        (item && map->entries[hole].item != item))
+        return -1;
+
+    free(map->entries[hole].key);
+    for (slot = (hole + 1) & mask; map->entries[slot].key; slot = (slot + 1) & mask) {
+        home = map->entries[slot].hash & mask;
+        if (in_probe_range(home, hole, slot)) {
+            map->entries[hole] = map->entries[slot];
+            hole = slot;
+        }
+    }
+    map->entries[hole].key = NULL;
+    map->entries[hole].item = NULL;
+    map->length--;
+    return map->length;
+}
+
+int strmap_free(struct strmap *map)
+{
+    int i;
+
+    if (!map)
+        return 0;
+    for (i = 0; i < map->capacity; i++)
+        free(map->entries[i].key);
+    free(map->entries);
+    free(map);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef PWMIXER_MAP_H
+#define PWMIXER_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* open addressing hash tables with linear probing and backward shift
+ * deletion, so lookups stay O(1) without tombstones piling up as
+ * registry objects come and go */
+
+struct idmap_entry {
+    uint32_t key;
+    void *item;
+};
+
+struct idmap {
+    struct idmap_entry *entries;
+    int length;
+    int capacity;
+};
+
+struct idmap *idmap_new(void);
+
+int idmap_put(struct idmap *map, uint32_t key, void *item);
+
+void *idmap_get(struct idmap *map, uint32_t key);
+
+int idmap_remove(struct idmap *map, uint32_t key, void *item);
+
+int idmap_free(struct idmap *map);
+
+struct strmap_entry {
+    uint32_t hash;
+    char *key;
+    void *item;
+};
+
+struct strmap {
+    struct strmap_entry *entries;
+    int length;
+    int capacity;
+};
+
+struct strmap *strmap_new(void);
+
+int strmap_put(struct strmap *map, const char *key, void *item);
+
+void *strmap_get(struct strmap *map, const char *key);
+
+int strmap_remove(struct strmap *map, const char *key, void *item);
+
+int strmap_free(struct strmap *map);
+
+#endif
@@ -0,0 +1,91 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "metrics.h"
+
+/* metrics sharing a name differ by their labels and are kept next to
+ * each other so the name is only described once */
+static const struct {
+    const char *name;
+    const char *labels;
+    const char *help;
+    /* printed as value * scale when set */
+    double scale;
+} descs[N_METRICS] = {
+    [METRIC_GLOBALS_BOUND] = { "pwmixer_globals_bound_total", NULL,
+        "Registry globals bound to a proxy." },
+    [METRIC_INFO_NODE] = { "pwmixer_info_events_total", "type=\"node\"",
+        "Info events received, by object type." },
+    [METRIC_INFO_DEVICE] = { "pwmixer_info_events_total", "type=\"device\"" },
+    [METRIC_INFO_PORT] = { "pwmixer_info_events_total", "type=\"port\"" },
+    [METRIC_INFO_LINK] = { "pwmixer_info_events_total", "type=\"link\"" },
+    [METRIC_PARAM_EVENTS] = { "pwmixer_param_events_total", NULL,
+        "Param events received from nodes and devices." },
+    [METRIC_REDRAWS_REQUESTED] = { "pwmixer_redraws_requested_total", NULL,
+        "Repaints asked for, bursts are folded into one frame." },
+    [METRIC_REDRAWS] = { "pwmixer_redraws_total", NULL,
+        "Frames drawn." },
+    [METRIC_SET_PARAM] = { "pwmixer_set_param_total", NULL,
+        "Volume and mute changes sent to the server." },
+    [METRIC_LOCK_WAIT] = { "pwmixer_lock_wait_seconds_total", NULL,
+        "Time spent waiting for the thread loop lock.", 1e-9 },
+    [METRIC_TERMINAL_BYTES] = { "pwmixer_terminal_bytes_total", NULL,
+        "Bytes written to the terminal." },
+};
+
+int metrics_print(const struct metrics *metrics, FILE *out)
+{
+    const char *last = NULL;
+    uint64_t value;
+    int i;
+
+    for (i = 0; i < N_METRICS; i++) {
+        if (last == NULL || strcmp(last, descs[i].name) != 0) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s counter\n",
+                descs[i].name, descs[i].help, descs[i].name);
+            last = descs[i].name;
+        }
+
+        fputs(descs[i].name, out);
+        if (descs[i].labels)
+            fprintf(out, "{%s}", descs[i].labels);
+
+        value = metrics_get(metrics, i);
+        if (descs[i].scale)
+            fprintf(out, " %.9f\n", value * descs[i].scale);
+        else
+            fprintf(out, " %" PRIu64 "\n", value);
+    }
+    return ferror(out) ? -EIO : 0;
+}
+
+int metrics_write(const struct metrics *metrics, const char *path)
+{
+    size_t len = strlen(path);
+    char *tmp;
+    FILE *file;
+    int res;
+
+    if (!(tmp = malloc(len + 5)))
+        return -ENOMEM;
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    if (!(file = fopen(tmp, "w"))) {
+        res = -errno;
+        goto done;
+    }
+    res = metrics_print(metrics, file);
+    if (fclose(file) != 0 && res == 0)
+        res = -errno;
+    if (res == 0 && rename(tmp, path) < 0)
+        res = -errno;
+    if (res < 0)
+        unlink(tmp);
+
+done:
+    free(tmp);
+    return res;
+}
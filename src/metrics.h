@@ -0,0 +1,52 @@
+#ifndef PWMIXER_METRICS_H
+#define PWMIXER_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* counters bumped from the event handlers of any thread with relaxed
+ * atomics, a zeroed struct metrics has them all at 0. they are written
+ * out in the prometheus text format for the textfile collector */
+
+enum metric {
+    METRIC_GLOBALS_BOUND,
+    METRIC_INFO_NODE,
+    METRIC_INFO_DEVICE,
+    METRIC_INFO_PORT,
+    METRIC_INFO_LINK,
+    METRIC_PARAM_EVENTS,
+    METRIC_REDRAWS_REQUESTED,
+    METRIC_REDRAWS,
+    METRIC_SET_PARAM,
+    /* nanoseconds, written out in seconds */
+    METRIC_LOCK_WAIT,
+    METRIC_TERMINAL_BYTES,
+    N_METRICS,
+};
+
+struct metrics {
+    uint64_t values[N_METRICS];
+};
+
+static inline void metrics_add(struct metrics *metrics, enum metric metric, uint64_t n)
+{
+    __atomic_fetch_add(&metrics->values[metric], n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_set(struct metrics *metrics, enum metric metric, uint64_t value)
+{
+    __atomic_store_n(&metrics->values[metric], value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t metrics_get(const struct metrics *metrics, enum metric metric)
+{
+    return __atomic_load_n(&metrics->values[metric], __ATOMIC_RELAXED);
+}
+
+int metrics_print(const struct metrics *metrics, FILE *out);
+
+/* writes a temporary file next to path and renames it over path, so a
+ * collector never reads half of it */
+int metrics_write(const struct metrics *metrics, const char *path);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+
+/* blocks start past the slab header, aligned for any object */
+#define SLAB_HEADER 16
+
+static int size_class(size_t size)
+{
+    int class = 0;
+
+    while (((size_t)1 << (class + POOL_MIN_SHIFT)) < size)
+        class++;
+    return class;
+}
+
+struct pool *pool_new(void)
+{
+    return calloc(1, sizeof(struct pool));
+}
+
+static int pool_refill(struct pool *pool, int class)
+{
+    size_t block = (size_t)1 << (class + POOL_MIN_SHIFT), offset;
+    struct pool_slab *slab;
+    char *data;
+
+    if (!(slab = malloc(POOL_SLAB_SIZE)))
+        return -1;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->n_slabs++;
+
+    data = (char*)slab;
+    for (offset = SLAB_HEADER; offset + block <= POOL_SLAB_SIZE; offset += block) {
+        *(void**)(data + offset) = pool->free[class];
+        pool->free[class] = data + offset;
+    }
+    return 0;
+}
+
+void *pool_alloc(struct pool *pool, size_t size)
+{
+    int class = size_class(size);
+    void *ptr;
+
+    if (class >= POOL_CLASSES)
+        return malloc(size);
+    if (!pool->free[class] && pool_refill(pool, class) < 0)
+        return NULL;
+
+    ptr = pool->free[class];
+    pool->free[class] = *(void**)ptr;
+    pool->n_blocks++;
+    return ptr;
+}
+
+void pool_release(struct pool *pool, void *ptr, size_t size)
+{
+    int class = size_class(size);
+
+    if (!ptr)
+        return;
+    if (class >= POOL_CLASSES) {
+        free(ptr);
+        return;
+    }
+    *(void**)ptr = pool->free[class];
+    pool->free[class] = ptr;
+    pool->n_blocks--;
+}
+
+int pool_free(struct pool *pool)
+{
+    struct pool_slab *slab, *next;
+
+    if (!pool)
+        return 0;
+    for (slab = pool->slabs; slab; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+    free(pool);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef PWMIXER_POOL_H
+#define PWMIXER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* slab allocator for small blocks, sizes are rounded up to a power of
+ * two and every class keeps a free list carved from 16KiB slabs; blocks
+ * above the largest class go to malloc. slabs are only given back when
+ * the pool is freed */
+
+#define POOL_MIN_SHIFT  4
+#define POOL_CLASSES    9
+#define POOL_SLAB_SIZE  16384
+
+struct pool_slab {
+    struct pool_slab *next;
+};
+
+struct pool {
+    void *free[POOL_CLASSES];
+    struct pool_slab *slabs;
+    size_t n_slabs;
+    size_t n_blocks;
+};
+
+struct pool *pool_new(void);
+
+void *pool_alloc(struct pool *pool, size_t size);
+
+/* size must be the one the block was allocated with */
+void pool_release(struct pool *pool, void *ptr, size_t size);
+
+int pool_free(struct pool *pool);
+
+#endif
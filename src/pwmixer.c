@@ -1,11 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include <string.h>
 #include <signal.h>
-#include <stdarg.h>
 #include <math.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 #include <curses.h>
 
 #include <spa/utils/result.h>
@@ -15,22 +26,63 @@
 #include <pipewire/pipewire.h>
 #include <pipewire/extensions/metadata.h>
 
-#include "array.h"
+#include "curve.h"
+#include "dsp.h"
+#include "filter.h"
+#include "histogram.h"
+#include "intern.h"
+#include "journal.h"
+#include "log.h"
+#include "map.h"
+#include "metrics.h"
+#include "pool.h"
+#include "pwmixer.h"
+#include "script.h"
+#include "vec.h"
 
 #define VOLUME_ZERO ((uint32_t) 0U)
 #define VOLUME_FULL ((uint32_t) 0x1000U)
 #define VOLUME_MAX  ((uint32_t) 0xA000U)
 
+#define DEFAULT_FPS 30
+
+#define FADE_DURATION       (2 * SPA_NSEC_PER_SEC)
+#define FADE_MIN_INTERVAL   (10 * SPA_NSEC_PER_MSEC)
+#define FADE_MAX_INTERVAL   (100 * SPA_NSEC_PER_MSEC)
+
+#define LIST_ROW    2
+#define BAR_COLUMN  66
+#define BAR_FULL    100
+#define BAR_MAX     150
+
+#define METER_NODE_NAME "pwmixer-meter"
+#define METER_POOL      32
+#define METER_RATE      8000
+#define METER_LATENCY   "256/8000"
+
+#define LOG_RECORDS 4096
+#define METRICS_INTERVAL 10
+#define LOCK_THRESHOLD 5
+
+#define REPLAY_BATCH    256
+#define REPLAY_MAX_ITEMS 256
+#define REPLAY_MAX_PARAMS 64
+
+/* longest command line a --daemon client may send, and how much output
+ * may pile up for it before it is dropped */
+#define CLIENT_LINE     1024
+#define CLIENT_MAX_OUT  (1 << 20)
+
+/* middle slot of the snapshot triple buffer, flagged while it holds a
+ * snapshot the ui has not picked up yet */
+#define SNAPSHOT_INDEX  0x3
+#define SNAPSHOT_FRESH  0x4
+
 struct volume {
     uint32_t n_channels;
     uint32_t values[SPA_AUDIO_MAX_CHANNELS];
 };
 
-enum volume_method {
-    VOLUME_METHOD_LINEAR,
-    VOLUME_METHOD_CUBIC,
-};
-
 enum node_flag {
     NODE_FLAG_SINK = 1 << 0,
     NODE_FLAG_SOURCE = 1 << 1,
@@ -41,18 +93,103 @@ enum node_flag {
 
 struct intf;
 
-struct group {
-    struct intf *parent;
-    struct intf *children[32];
-    int n_children;
+enum journal_event {
+    JOURNAL_GLOBAL = 1,
+    JOURNAL_GLOBAL_REMOVE,
+    JOURNAL_INFO,
+    JOURNAL_PARAM,
+    JOURNAL_PROPERTY,
+};
+
+/* the only properties kept for every object, all other keys are
+ * dropped unless full properties were asked for */
+enum prop_key {
+    PROP_NODE_NAME,
+    PROP_MEDIA_NAME,
+    PROP_NODE_VIRTUAL,
+    PROP_OBJECT_SERIAL,
+    PROP_NODE_ID,
+    N_PROPS,
+};
+
+enum row_flag {
+    ROW_PARENT = 1 << 0,
+    ROW_ACTIVE = 1 << 1,
+    ROW_END = 1 << 2,
+    ROW_DEFAULT = 1 << 3,
+    ROW_MUTE = 1 << 4,
+    ROW_BLANK = 1 << 5,
+    ROW_UNSET = 1 << 6,
+};
+
+/* what was last painted on a screen row, a row is only rewritten when
+ * the node or any of its displayed state differs */
+struct row_cache {
+    uint32_t id;
+    uint32_t flags;
+    int volume;
+    int rms;
+    int peak;
+    char name[256];
+};
+
+/* one selectable line of the flattened group list, line counts the
+ * blank separators between groups as well */
+struct row {
+    struct intf *intf;
+    uint32_t flags;
+    int line;
+};
+
+/* immutable copy of a row as the ui shows it, the name is an offset
+ * into the names of the snapshot */
+struct snap_row {
+    uint32_t id;
+    uint32_t flags;
+    int line;
+    int volume;
+    uint32_t name;
+    struct meter *meter;
+};
+
+/* everything the ui draws, built on the pipewire thread and handed over
+ * whole so redraw never touches the model */
+struct snapshot {
+    struct snap_row *rows;
+    uint32_t n_rows;
+    uint32_t max_rows;
+    char *names;
+    uint32_t names_len;
+    uint32_t names_size;
+    int n_lines;
+};
+
+/* one place taking the thread loop lock, --lock-profile keeps the time
+ * spent waiting for it and holding it apart for each */
+struct lock_site {
+    const char *name;
+    struct lock_site *next;
+    bool listed;
+    uint64_t locked;
+    struct histogram wait;
+    struct histogram hold;
+};
+
+/* a node linked to another one, counted once however many port links
+ * there are between the two */
+struct peer {
+    struct intf *node;
+    int n_links;
 };
 
 struct ctl {
     struct pw_thread_loop *mainloop;
+    struct pw_loop *loop;
     struct pw_context *context;
     struct spa_system *system;
 
     struct pw_core *core;
+    struct spa_hook core_listener;
 
     struct pw_registry *registry;
     struct spa_hook registry_listener;
@@ -61,21 +198,185 @@ struct ctl {
     struct spa_hook metadata_listener;
 
     int fd;
+    int signal_fd;
+    int dirty;
+    uint64_t frame_interval;
+    uint64_t last_frame;
+    uint64_t key_time;
     int pending_seq;
     int last_seq;
     int error;
 
-    enum volume_method volume_method;
+    /* nodes with a volume/mute change waiting for the next round-trip */
+    struct spa_list pending;
+    uint32_t n_requested;
+    uint32_t n_flushed;
+    uint32_t n_coalesced;
+    uint64_t sync_time;
+    uint64_t round_trip;
+
+    /* nanoseconds from a set_param to its Props coming back, from that
+     * update to the screen and from a key to the screen; param_time is
+     * the matched update waiting for the next frame */
+    struct histogram param_latency;
+    struct histogram draw_latency;
+    struct histogram key_latency;
+    uint64_t param_time;
+    bool overlay;
+
+    /* counters for --metrics, written out by metrics_timer; terminal
+     * bytes come from the io accounting of the thread running curses */
+    struct metrics metrics;
+    const char *metrics_path;
+    struct spa_source *metrics_timer;
+    int screen_tid;
+    uint64_t screen_wchar;
+
+    /* --lock-profile: the sites seen so far, the one holding the lock
+     * and the pipewire thread itself, timed from the loop hooks */
+    bool lock_profile;
+    uint64_t lock_threshold;
+    struct lock_site *lock_sites;
+    struct lock_site *lock_holder;
+    struct lock_site loop_site;
+    struct spa_hook loop_hook;
+
+    /* subcommands sync until a round-trip comes back without a bind or
+     * param enumeration having gone out while it was in flight */
+    bool batch;
+    bool settled;
+    int settle_seq;
+    uint32_t n_queries;
+    uint32_t settle_queries;
+
+    /* --daemon serves the model to clients of a unix socket from the
+     * pipewire loop */
+    struct spa_source *listen_source;
+    struct spa_list clients;
+    uint32_t n_subscribers;
+    char socket_path[108];
+    bool quit;
+
+    /* change events waiting for the end of the loop iteration */
+    bool watch;
+    char *events;
+    size_t events_len;
+    size_t events_size;
+    struct spa_source *events_source;
+
+    /* running volume ramps, all stepped by one timer */
+    struct spa_list fades;
+    struct spa_source *fade_timer;
+    uint64_t fade_in;
+
+    bool meters;
+    struct meter *meter_pool;
+    uint32_t n_meter_pool;
+
+    /* ids of the nodes on screen in the last frame */
+    uint32_t *visible;
+    uint32_t n_visible;
+    uint32_t max_visible;
+
+    /* registry traffic written out by --record, or fed back from a
+     * journal by --replay instead of a server */
+    struct journal *journal;
+    uint64_t journal_start;
+    struct journal *replay;
+    struct spa_source *replay_timer;
+    uint64_t replay_start;
+    double replay_speed;
+
+    /* volume positions to the gains the server takes, cubic unless
+     * --curve asks for another */
+    struct curve *curve;
+
+    /* ports and links are kept from their registry globals alone and are
+     * never bound */
+    bool lazy_ports;
+
+    /* overflow of the per object link lists and the peers in them */
+    struct pool *pool;
+
+    /* property values shared between objects */
+    struct intern *intern;
+
+    /* nodes left out by the filter, and so are their ports and links */
+    struct filter *filter;
+    struct idmap *skipped;
 
     char default_sink[1024];
     char default_source[1024];
     struct spa_list refs;
+    struct idmap *ids;
+    struct strmap *names;
+    struct spa_list groups;
     uint32_t n_refs;
     uint32_t cursor;
+    int scroll;
     enum node_flag node_flags;
 
-    struct group group[32];
-    int n_group;
+    struct row *rows;
+    uint32_t n_rows;
+    uint32_t max_rows;
+    int n_lines;
+    bool layout_dirty;
+
+    /* triple buffer between the pipewire thread, which owns the back
+     * snapshot, and the ui, which owns the front one; the middle index
+     * is only ever exchanged atomically */
+    struct snapshot snapshots[3];
+    int snap_back;
+    int snap_front;
+    int snap_middle;
+    struct spa_source *publish_timer;
+    bool publish_pending;
+    uint64_t last_publish;
+
+    SCREEN *screen;
+    struct row_cache *row_cache;
+    int n_row_cache;
+    int n_rows_drawn;
+    enum node_flag header_flags;
+};
+
+/* pooled capture stream measuring the signal level of the node it is
+ * currently bound to, written from the realtime thread and read by the
+ * ui */
+struct meter {
+    struct ctl *ctl;
+    struct intf *intf;
+    struct pw_stream *stream;
+    struct spa_hook listener;
+    bool used;
+    float peak;
+    float rms;
+};
+
+/* connection to the --daemon socket, requests are read a line at a time
+ * and replies queue up in out while the socket is full */
+struct client {
+    struct spa_list link;
+    struct ctl *ctl;
+    struct spa_source *source;
+    int fd;
+    uint32_t mask;
+    bool subscribed;
+    bool eof;
+    char in[CLIENT_LINE];
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    size_t out_size;
+};
+
+struct fade {
+    struct spa_list link;
+    struct intf *intf;
+    struct volume from;
+    struct volume to;
+    uint64_t start;
+    uint64_t duration;
 };
 
 struct intf_info {
@@ -84,6 +385,8 @@ struct intf_info {
     const void *events;
     void (*init) (void *data);
     pw_destroy_t destroy;
+    /* mask of the prop_keys read for this type */
+    uint32_t props;
 };
 
 struct intf {
@@ -94,10 +397,12 @@ struct intf {
     struct spa_hook proxy_listener;
     struct spa_hook object_listener;
 
-    struct pw_properties *props;
+    const char *props[N_PROPS];
     uint32_t id;
     uint32_t perms;
     const struct intf_info *info;
+    /* last set_param not answered by a Props update yet */
+    uint64_t set_time;
 
     union {
         struct {
@@ -109,8 +414,40 @@ struct intf {
             bool mute;
             struct volume channel_volume;
 
-            struct array *ports;
-            struct array *links;
+            struct vec ports;
+            struct vec links;
+
+            /* peers feeding into this node and fed by it */
+            struct vec upstream;
+            struct vec downstream;
+            struct spa_list group_link;
+            bool grouped;
+
+            /* level to come back to after a fade out */
+            struct volume fade_level;
+
+            struct meter *meter;
+
+            /* last state written out as events, -1 for unknown */
+            struct {
+                bool added;
+                int volume;
+                int mute;
+            } shown;
+
+            /* latest-wins slot, flushed once per server round-trip */
+            struct {
+                bool queued;
+                bool has_volume;
+                bool has_mute;
+                int mute;
+                struct volume volume;
+                struct spa_list link;
+                /* last volume sent, steps start from it until the
+                 * server reports channelVolumes back */
+                bool has_sent;
+                struct volume sent;
+            } pending;
         } node;
         struct {
             uint32_t active_route_input;
@@ -121,7 +458,7 @@ struct intf {
             uint32_t node;
 
             struct intf *node_ref;
-            struct array *links;
+            struct vec links;
         } port;
         struct {
             uint32_t output_port;
@@ -133,26 +470,111 @@ struct intf {
             struct intf *output_node_ref;
             struct intf *input_port_ref;
             struct intf *input_node_ref;
+            bool connected;
+            bool shown;
         } link;
     };
 };
 
-static FILE *log_file;
+static uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* must be called with the lock just taken */
+static void lock_taken(struct ctl *ctl, struct lock_site *site, uint64_t now)
+{
+    if (!site->listed) {
+        site->next = ctl->lock_sites;
+        site->listed = true;
+        __atomic_store_n(&ctl->lock_sites, site, __ATOMIC_RELEASE);
+    }
+    site->locked = now;
+    ctl->lock_holder = site;
+}
 
-static void log_debug(const char *format, ...)
+/* must be called right before the lock is let go; a nested lock leaves
+ * the outer hold untimed */
+static void lock_released(struct ctl *ctl)
 {
-    if (log_file == NULL)
+    struct lock_site *site = ctl->lock_holder;
+    uint64_t hold;
+
+    if (site == NULL)
         return;
+    ctl->lock_holder = NULL;
+
+    hold = get_time_ns() - site->locked;
+    histogram_record(&site->hold, hold);
+    if (hold > ctl->lock_threshold)
+        log_warn("%s held the loop lock for %" PRIu64 "us", site->name,
+            (uint64_t)(hold / SPA_NSEC_PER_USEC));
+}
+
+/* the thread loop lock as taken from outside the loop, counting the
+ * time spent waiting for it */
+static void lock_loop_at(struct ctl *ctl, struct lock_site *site)
+{
+    uint64_t start = get_time_ns(), now;
+
+    pw_thread_loop_lock(ctl->mainloop);
+    now = get_time_ns();
+    metrics_add(&ctl->metrics, METRIC_LOCK_WAIT, now - start);
+    if (ctl->lock_profile) {
+        histogram_record(&site->wait, now - start);
+        lock_taken(ctl, site, now);
+    }
+}
+
+#define lock_loop(ctl)                                  \
+    do {                                                \
+        static struct lock_site _site = { __func__ };   \
+        lock_loop_at(ctl, &_site);                      \
+    } while (0)
+
+static void unlock_loop(struct ctl *ctl)
+{
+    if (ctl->lock_profile)
+        lock_released(ctl);
+    pw_thread_loop_unlock(ctl->mainloop);
+}
+
+/* the lock is let go while waiting, that is not counted as held */
+static void wait_loop(struct ctl *ctl)
+{
+    struct lock_site *site = ctl->lock_holder;
+
+    if (ctl->lock_profile)
+        lock_released(ctl);
+    pw_thread_loop_wait(ctl->mainloop);
+    if (ctl->lock_profile && site != NULL)
+        lock_taken(ctl, site, get_time_ns());
+}
+
+/* the pipewire thread holds the lock from the end of one poll to the
+ * start of the next, dispatching in between; these hooks run inside
+ * the ones of the thread loop that take and drop the lock */
+static void on_loop_before(void *data)
+{
+    lock_released(data);
+}
 
-    va_list args;
-    va_start(args, format);
-    vfprintf(log_file, format, args);
-    va_end(args);
+static void on_loop_after(void *data)
+{
+    struct ctl *ctl = data;
 
-    fprintf(log_file, "\n");
-    fflush(log_file);
+    lock_taken(ctl, &ctl->loop_site, get_time_ns());
 }
 
+static const struct spa_loop_control_hooks loop_hooks = {
+    SPA_VERSION_LOOP_CONTROL_HOOKS,
+    .before = on_loop_before,
+    .after = on_loop_after,
+};
+
 static int bound_int(int val, int min, int max)
 {
     if (val < min)
@@ -163,76 +585,91 @@ static int bound_int(int val, int min, int max)
         return val;
 }
 
-static uint32_t volume_from_linear(float vol, enum volume_method method)
+/** props */
+
+static const char * const prop_keys[N_PROPS] = {
+    [PROP_NODE_NAME] = PW_KEY_NODE_NAME,
+    [PROP_MEDIA_NAME] = PW_KEY_MEDIA_NAME,
+    [PROP_NODE_VIRTUAL] = PW_KEY_NODE_VIRTUAL,
+    [PROP_OBJECT_SERIAL] = PW_KEY_OBJECT_SERIAL,
+    [PROP_NODE_ID] = PW_KEY_NODE_ID,
+};
+
+static const char *intf_prop(struct intf *intf, enum prop_key key)
 {
-    switch (method) {
-    case VOLUME_METHOD_CUBIC:
-        vol = cbrtf(vol);
-        break;
-    }
-    return bound_int(lroundf(vol * VOLUME_FULL), VOLUME_ZERO, VOLUME_MAX);
+    return intf->props[key];
 }
 
-static float volume_to_linear(uint32_t vol, enum volume_method method)
+static void intf_set_prop(struct intf *intf, enum prop_key key, const char *value)
 {
-    float v = ((float)vol) / VOLUME_FULL;
+    const char *old = intf->props[key];
 
-    switch (method) {
-    case VOLUME_METHOD_CUBIC:
-        v = v * v * v;
-        break;
+    intf->props[key] = intern_get(intf->ctl->intern, value);
+    intern_put(intf->ctl->intern, old);
+}
+
+/* keys missing from dict keep their value, as pw_properties_update does */
+static void intf_update_props(struct intf *intf, const struct spa_dict *dict)
+{
+    const char *str;
+    int key;
+
+    for (key = 0; key < N_PROPS; key++) {
+        if (intf->info->props & (1 << key) &&
+            (str = spa_dict_lookup(dict, prop_keys[key])) != NULL)
+            intf_set_prop(intf, key, str);
     }
-    return v;
+}
+
+static void intf_clear_props(struct intf *intf)
+{
+    for (int key = 0; key < N_PROPS; key++)
+        intf_set_prop(intf, key, NULL);
 }
 
 static struct intf *find_node(struct ctl *ctl, uint32_t id,
     const char *name, const char *type)
 {
     struct intf *intf;
-    const char *str;
 
-    spa_list_for_each(intf, &ctl->refs, ref) {
-        if (intf->id == id &&
-            (type == NULL || spa_streq(intf->info->type, type)))
-        {
-            return intf;
-        }
-        if (name != NULL && name[0] != '\0' &&
-            (str = pw_properties_get(intf->props, PW_KEY_NODE_NAME)) != NULL &&
-            spa_streq(name, str))
-        {
-            return intf;
-        }
+    if ((intf = idmap_get(ctl->ids, id)) != NULL &&
+        (type == NULL || spa_streq(intf->info->type, type)))
+    {
+        return intf;
     }
+    if (name != NULL && name[0] != '\0')
+        return strmap_get(ctl->names, name);
     return NULL;
 }
 
-static struct intf *find_curnode(struct ctl *ctl)
+static void index_node_name(struct ctl *ctl, struct intf *intf,
+    const char *old_name, const char *name)
 {
-    struct intf *intf[2];
-    int cur = 0;
+    struct intf *other;
+    const char *str;
 
-    for (int i = 0; i < ctl->n_group; i++) {
-        if (cur == ctl->cursor)
-            return ctl->group[i].parent;
-        else if (cur + ctl->group[i].n_children > ctl->cursor) {
-            cur += 1 + ctl->group[i].n_children;
-            continue;
-        }
+    if (spa_streq(old_name, name))
+        return;
 
-        for (int j = 0; j < ctl->group[i].n_children; j++) {
-            cur++;
-            if (cur == ctl->cursor)
-                return ctl->group[i].children[j];
+    if (old_name != NULL && strmap_remove(ctl->names, old_name, intf) >= 0) {
+        /* node names are not unique, hand the slot to the next holder */
+        spa_list_for_each(other, &ctl->refs, ref) {
+            if (other != intf &&
+                spa_streq(other->info->type, PW_TYPE_INTERFACE_Node) &&
+                (str = intf_prop(other, PROP_NODE_NAME)) &&
+                spa_streq(str, old_name))
+            {
+                strmap_put(ctl->names, old_name, other);
+                break;
+            }
         }
-        cur++;
     }
-
-    return NULL;
+    if (name != NULL && strmap_get(ctl->names, name) == NULL)
+        strmap_put(ctl->names, name, intf);
 }
 
 static struct spa_pod *build_volume_mute(struct spa_pod_builder *b,
-    struct volume *volume, int *mute, int volume_method)
+    struct volume *volume, int *mute, const struct curve *curve)
 {
     struct spa_pod_frame f[1];
 
@@ -241,8 +678,7 @@ static struct spa_pod *build_volume_mute(struct spa_pod_builder *b,
     if (volume != NULL) {
         float values[SPA_AUDIO_MAX_CHANNELS];
 
-        for (uint32_t i = 0; i < volume->n_channels; i++)
-            values[i] = volume_to_linear(volume->values[i], volume_method);
+        curve_to_linear_n(curve, volume->values, values, volume->n_channels);
 
         spa_pod_builder_prop(b, SPA_PROP_channelVolumes, 0);
         spa_pod_builder_array(b, sizeof(float),
@@ -255,28 +691,48 @@ static struct spa_pod *build_volume_mute(struct spa_pod_builder *b,
     return spa_pod_builder_pop(b, &f[0]);
 }
 
+/* the device whose active route carries the volume of intf, NULL when
+ * it is set on the node itself */
+static struct intf *route_device(struct intf *intf, uint32_t *id, uint32_t *device_id)
+{
+    struct intf *dintf;
+
+    *id = SPA_ID_INVALID;
+    *device_id = SPA_ID_INVALID;
+    dintf = find_node(intf->ctl, intf->node.device_id, NULL, PW_TYPE_INTERFACE_Device);
+    if (dintf == NULL)
+        return NULL;
+
+    if (SPA_FLAG_IS_SET(intf->node.flags, NODE_FLAG_SINK))
+        *id = dintf->device.active_route_output;
+    else if (SPA_FLAG_IS_SET(intf->node.flags, NODE_FLAG_SOURCE))
+        *id = dintf->device.active_route_input;
+    *device_id = intf->node.profile_device_id;
+
+    log_debug("route #%d, #%d id:%d device_id:%d", intf->id,
+        dintf->id, *id, *device_id);
+    return *id != SPA_ID_INVALID && *device_id != SPA_ID_INVALID ? dintf : NULL;
+}
+
+static bool can_set_volume(struct intf *intf)
+{
+    uint32_t id, device_id;
+    struct intf *dintf = route_device(intf, &id, &device_id);
+
+    return SPA_FLAG_IS_SET((dintf ? dintf : intf)->perms, PW_PERM_W | PW_PERM_X);
+}
+
 static int set_volume_mute(struct intf *intf, struct volume *volume, int *mute)
 {
     struct intf *dintf;
     struct ctl *ctl = intf->ctl;
-    uint32_t id = SPA_ID_INVALID, device_id = SPA_ID_INVALID;
+    uint32_t id, device_id;
     char buf[1024];
     struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buf, sizeof(buf));
     struct spa_pod_frame f[2];
     struct spa_pod *param;
 
-    if ((dintf = find_node(ctl, intf->node.device_id, NULL, PW_TYPE_INTERFACE_Device)) != NULL) {
-        if (SPA_FLAG_IS_SET(intf->node.flags, NODE_FLAG_SINK))
-            id = dintf->device.active_route_output;
-        else if (SPA_FLAG_IS_SET(intf->node.flags, NODE_FLAG_SOURCE))
-            id = dintf->device.active_route_input;
-        device_id = intf->node.profile_device_id;
-
-        log_debug("route #%d, #%d id:%d device_id:%d", intf->id,
-            dintf->id, id, device_id);
-    }
-
-    if (id != SPA_ID_INVALID && device_id != SPA_ID_INVALID && dintf != NULL) {
+    if ((dintf = route_device(intf, &id, &device_id)) != NULL) {
         if (!SPA_FLAG_IS_SET(dintf->perms, PW_PERM_W | PW_PERM_X))
             return -EPERM;
 
@@ -289,954 +745,4010 @@ static int set_volume_mute(struct intf *intf, struct volume *volume, int *mute)
             0);
 
         spa_pod_builder_prop(&b, SPA_PARAM_ROUTE_props, 0);
-        build_volume_mute(&b, volume, mute, ctl->volume_method);
+        build_volume_mute(&b, volume, mute, ctl->curve);
         param = spa_pod_builder_pop(&b, &f[0]);
 
         log_debug("set device #%d volume/mute for node #%d",
             intf->node.device_id, intf->id);
         pw_device_set_param((struct pw_device*)dintf->proxy,
             SPA_PARAM_Route, 0, param);
+        dintf->set_time = get_time_ns();
+        metrics_add(&ctl->metrics, METRIC_SET_PARAM, 1);
     } else {
         if (!SPA_FLAG_IS_SET(intf->perms, PW_PERM_W | PW_PERM_X))
             return -EPERM;
 
-        param = build_volume_mute(&b, volume, mute, ctl->volume_method);
+        param = build_volume_mute(&b, volume, mute, ctl->curve);
 
         log_debug("set node #%d volume/mute", intf->id);
         pw_node_set_param((struct pw_node*)intf->proxy,
             SPA_PARAM_Props, 0, param);
+        intf->set_time = get_time_ns();
+        metrics_add(&ctl->metrics, METRIC_SET_PARAM, 1);
     }
     return 0;
 }
 
-static void ctl_pipewire_free(struct ctl *ctl)
+/* send every queued change and start a round-trip, the next batch goes
+ * out when the server acknowledged this one */
+static void flush_pending(struct ctl *ctl)
 {
-    if (ctl == NULL)
+    struct intf *intf;
+    int res;
+
+    if (ctl->pending_seq != ctl->last_seq || spa_list_is_empty(&ctl->pending))
         return;
 
-    if (ctl->mainloop)
-        pw_thread_loop_stop(ctl->mainloop);
-    if (ctl->registry)
-        pw_proxy_destroy((struct pw_proxy*)ctl->registry);
-    if (ctl->context)
-        pw_context_destroy(ctl->context);
-    if (ctl->fd >= 0)
-        spa_system_close(ctl->system, ctl->fd);
-    if (ctl->mainloop)
-        pw_thread_loop_destroy(ctl->mainloop);
-}
+    spa_list_consume(intf, &ctl->pending, node.pending.link) {
+        spa_list_remove(&intf->node.pending.link);
+        intf->node.pending.queued = false;
+
+        /* apply_command() already refused nodes the client cannot
+         * write, the permissions may have changed since */
+        res = set_volume_mute(intf,
+            intf->node.pending.has_volume ? &intf->node.pending.volume : NULL,
+            intf->node.pending.has_mute ? &intf->node.pending.mute : NULL);
+        if (res < 0) {
+            log_warn("cannot change node#%d: %s", intf->id, spa_strerror(res));
+        } else if (intf->node.pending.has_volume) {
+            intf->node.pending.sent = intf->node.pending.volume;
+            intf->node.pending.has_sent = true;
+        }
+        intf->node.pending.has_volume = false;
+        intf->node.pending.has_mute = false;
+        ctl->n_flushed++;
+    }
 
-static enum pw_direction cur_direction(struct ctl *ctl)
-{
-    if (ctl->node_flags & NODE_FLAG_SINK)
-        return PW_DIRECTION_INPUT;
-    else
-        return PW_DIRECTION_OUTPUT;
+    if ((res = pw_core_sync(ctl->core, PW_ID_CORE, 0)) < 0) {
+        /* nothing will acknowledge it, let the next batch go out */
+        log_error("cannot sync: %s", spa_strerror(res));
+        ctl->error = res;
+        return;
+    }
+    ctl->pending_seq = res;
+    ctl->sync_time = get_time_ns();
 }
 
-/** curses */
-
-static void init_curses(struct ctl *ctl)
+/* fill the slot of intf without sending it, the next flush_pending()
+ * picks it up */
+static void stage_volume_mute(struct intf *intf, struct volume *volume, int *mute)
 {
-    setlocale(LC_ALL, "");
-
-    initscr();              // Start curses mode
-    cbreak();               // Line buffering disabled
-    noecho();               // Do not echo while typing
-    keypad(stdscr, true);   // Enable special keys
-    curs_set(0);            // Hide cursor
+    struct ctl *ctl = intf->ctl;
 
-    if (has_colors()) {
-        start_color();
+    ctl->n_requested++;
+    if (intf->node.pending.queued)
+        ctl->n_coalesced++;
 
-        init_pair(1, COLOR_RED,     COLOR_BLACK);
-        init_pair(2, COLOR_GREEN,   COLOR_BLACK);
-        init_pair(3, COLOR_YELLOW,  COLOR_BLACK);
-        init_pair(4, COLOR_BLUE,    COLOR_BLACK);
-        init_pair(5, COLOR_CYAN,    COLOR_BLACK);
-        init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
-        init_pair(7, COLOR_WHITE,   COLOR_BLACK);
+    if (volume != NULL) {
+        intf->node.pending.volume = *volume;
+        intf->node.pending.has_volume = true;
+    }
+    if (mute != NULL) {
+        intf->node.pending.mute = *mute;
+        intf->node.pending.has_mute = true;
+    }
+    if (!intf->node.pending.queued) {
+        spa_list_append(&ctl->pending, &intf->node.pending.link);
+        intf->node.pending.queued = true;
     }
 }
 
-static void sync_active(struct ctl *ctl)
+/* must be called with the thread loop locked */
+static void queue_volume_mute(struct intf *intf, struct volume *volume, int *mute)
 {
-    struct intf *intf, *target[2], **children;
-    enum pw_direction direction = cur_direction(ctl);
-    int dup[32], n_dup, d, n_children, rows;
+    /* replayed objects have no server to change them on */
+    if (intf->proxy == NULL)
+        return;
 
-    rows = 0;
-    ctl->n_group = 0;
-    spa_list_for_each(intf, &ctl->refs, ref) {
-        if (!spa_streq(intf->info->type, PW_TYPE_INTERFACE_Node))
-            continue;
-        if (!SPA_FLAG_IS_SET(intf->node.flags, ctl->node_flags))
-            continue;
+    stage_volume_mute(intf, volume, mute);
+    flush_pending(intf->ctl);
+}
 
-        children = ctl->group[ctl->n_group].children;
-        n_children = 0;
-        n_dup = 0;
-        for (int i = 0; i < intf->node.links->length; i++) {
-            target[0] = array_get(intf->node.links, i);
-            if (direction == PW_DIRECTION_INPUT)
-                target[1] = target[0]->link.output_node_ref;
-            else
-                target[1] = target[0]->link.input_node_ref;
-            if (intf->id == target[1]->id)
-                continue;
+static void cancel_pending(struct intf *intf)
+{
+    if (!intf->node.pending.queued)
+        return;
+    spa_list_remove(&intf->node.pending.link);
+    intf->node.pending.queued = false;
+    intf->node.pending.has_volume = false;
+    intf->node.pending.has_mute = false;
+    intf->node.pending.has_sent = false;
+}
 
-            for (d = 0; d < n_dup; d++)
-                if (dup[d] == target[1]->id)
-                    break;
-            if (d >= n_dup)
-                dup[n_dup++] = target[1]->id;
-            else
-                continue;
+/** fades */
 
-            children[n_children++] = target[1];
-        }
+/* the volume the node will have once everything sent and staged is
+ * applied */
+static struct volume *queued_volume(struct intf *intf)
+{
+    if (intf->node.pending.has_volume)
+        return &intf->node.pending.volume;
+    if (intf->node.pending.has_sent)
+        return &intf->node.pending.sent;
+    return &intf->node.channel_volume;
+}
 
-        ctl->group[ctl->n_group].n_children = n_children;
-        ctl->group[ctl->n_group].parent = intf;
-        ctl->n_group++;
+/* step as fast as the server acknowledges changes, there is no point
+ * in queueing steps that would be coalesced anyway */
+static void update_fade_timer(struct ctl *ctl)
+{
+    struct timespec value = { 0, 0 };
+    uint64_t interval;
 
-        rows += 1 + n_children;
+    if (!spa_list_is_empty(&ctl->fades)) {
+        interval = SPA_CLAMP(ctl->round_trip, FADE_MIN_INTERVAL, FADE_MAX_INTERVAL);
+        value.tv_sec = interval / SPA_NSEC_PER_SEC;
+        value.tv_nsec = interval % SPA_NSEC_PER_SEC;
     }
-
-    ctl->n_refs = rows;
+    pw_loop_update_timer(ctl->loop, ctl->fade_timer, &value, NULL, false);
 }
 
-static void draw_intf(struct intf *intf, int row,
-    int is_parent, int is_active, int is_end)
+static void on_fade_timeout(void *data, uint64_t expirations)
 {
-    struct ctl *ctl = intf->ctl;
-    const char *str;
-    int b, vol, i;
+    struct ctl *ctl = data;
+    struct fade *fade, *t;
+    struct volume vol;
+    uint64_t now = get_time_ns();
+    float progress;
+
+    spa_list_for_each_safe(fade, t, &ctl->fades, link) {
+        progress = fade->duration ?
+            (float)(now - fade->start) / fade->duration : 1.0f;
+        if (progress > 1.0f)
+            progress = 1.0f;
+
+        vol.n_channels = fade->to.n_channels;
+        for (uint32_t i = 0; i < vol.n_channels; i++)
+            vol.values[i] = lroundf(fade->from.values[i] +
+                ((float)fade->to.values[i] - fade->from.values[i]) * progress);
+        queue_volume_mute(fade->intf, &vol, NULL);
+
+        if (progress >= 1.0f) {
+            spa_list_remove(&fade->link);
+            free(fade);
+        }
+    }
 
-    move(row, 0);
-    clrtoeol();
+    update_fade_timer(ctl);
+}
 
-    if (is_active)
-        attron(A_BOLD);
+static void cancel_fade(struct intf *intf)
+{
+    struct fade *fade, *t;
 
-    if ((str = pw_properties_get(intf->props, PW_KEY_NODE_NAME)) &&
-        (spa_streq(str, ctl->default_sink) || spa_streq(str, ctl->default_source)))
-    {
-        move(row, 1);
-        printw("*");
+    spa_list_for_each_safe(fade, t, &intf->ctl->fades, link) {
+        if (fade->intf == intf) {
+            spa_list_remove(&fade->link);
+            free(fade);
+        }
     }
+}
 
-    move(row, 2);
-    if (!is_parent && !is_end)
-        printw("|─");
-    else if (!is_parent)
-        printw("└─");
+/* must be called with the thread loop locked */
+static int start_fade(struct intf *intf, struct volume *to, uint64_t duration)
+{
+    struct ctl *ctl = intf->ctl;
+    struct fade *fade;
+    bool idle = spa_list_is_empty(&ctl->fades);
+
+    if (to->n_channels == 0)
+        return -EINVAL;
+
+    cancel_fade(intf);
+    if ((fade = calloc(1, sizeof(struct fade))) == NULL)
+        return -ENOMEM;
+
+    fade->intf = intf;
+    fade->from = *queued_volume(intf);
+    fade->to = *to;
+    fade->from.n_channels = fade->to.n_channels;
+    fade->start = get_time_ns();
+    fade->duration = duration;
+    spa_list_append(&ctl->fades, &fade->link);
+
+    if (idle)
+        update_fade_timer(ctl);
+    return 0;
+}
 
-    if ((b = pw_properties_get_bool(intf->props, PW_KEY_NODE_VIRTUAL, 0)))
-        printw("%s", pw_properties_get(intf->props, PW_KEY_NODE_NAME));
-    else if (intf->node.flags & NODE_FLAG_STREAM)
-        printw("%s: %s",
-            pw_properties_get(intf->props, PW_KEY_NODE_NAME),
-            pw_properties_get(intf->props, PW_KEY_MEDIA_NAME));
-    else
-        printw("%s", pw_properties_get(intf->props, PW_KEY_NODE_NAME));
+/* fade out to silence, or back to the level before the last fade out */
+static void toggle_fade(struct intf *intf)
+{
+    struct volume *cur = queued_volume(intf), to;
+    bool silent = true;
 
-    move(row, 60);
-    vol = lroundf((float)intf->node.channel_volume.values[0] / VOLUME_FULL * 100);
-    printw("%d", vol);
+    for (uint32_t i = 0; i < cur->n_channels; i++)
+        if (cur->values[i] != VOLUME_ZERO)
+            silent = false;
 
-    if (intf->node.mute) {
-        move(row, 64);
-        attron(COLOR_PAIR(3));
-        printw("M");
-        attroff(COLOR_PAIR(3));
+    if (silent && intf->node.fade_level.n_channels > 0) {
+        to = intf->node.fade_level;
+        intf->node.fade_level.n_channels = 0;
+    } else {
+        intf->node.fade_level = *cur;
+        to.n_channels = cur->n_channels;
+        for (uint32_t i = 0; i < to.n_channels; i++)
+            to.values[i] = VOLUME_ZERO;
     }
+    start_fade(intf, &to, FADE_DURATION);
+}
 
-    move(row, 66);
-    if (!intf->node.mute)
-        attron(COLOR_PAIR(2));
-    for (i = 0; i < vol && i < 150; i++)
-        printw("|");
-    if (!intf->node.mute)
-        attroff(COLOR_PAIR(2));
+static enum pw_direction cur_direction(struct ctl *ctl)
+{
+    if (ctl->node_flags & NODE_FLAG_SINK)
+        return PW_DIRECTION_INPUT;
+    else
+        return PW_DIRECTION_OUTPUT;
+}
 
-    for (; i < 100; i++)
-        printw("-");
+/** grouping */
 
-    if (is_active)
-        attroff(A_BOLD);
-}
+static void diff_link(struct intf *link);
 
-static void redraw(struct ctl *ctl)
+static void peer_add(struct ctl *ctl, struct vec *peers, struct intf *node)
 {
-    struct intf *intf, *child;
-    enum pw_direction direction = cur_direction(ctl);
-    int is_active, row = 0, cur = -1, i, j;
+    struct peer *peer;
 
-    sync_active(ctl);
+    for (uint32_t i = 0; i < peers->length; i++) {
+        peer = vec_get(peers, i);
+        if (peer->node == node) {
+            peer->n_links++;
+            return;
+        }
+    }
 
-    move(row, 1);
-    if (ctl->node_flags & NODE_FLAG_SINK)
-        attron(A_BOLD);
-    else
-        attroff(A_BOLD);
-    printw("F1 Output");
-    attroff(A_BOLD);
+    if ((peer = pool_alloc(ctl->pool, sizeof(struct peer))) == NULL)
+        return;
+    peer->node = node;
+    peer->n_links = 1;
+    if (vec_append(peers, ctl->pool, peer) < 0)
+        pool_release(ctl->pool, peer, sizeof(struct peer));
+}
 
-    printw("  ");
-    if (ctl->node_flags & NODE_FLAG_SOURCE)
-        attron(A_BOLD);
-    else
-        attroff(A_BOLD);
-    printw("F2 Input");
-    attroff(A_BOLD);
-    clrtoeol();
+static void peer_remove(struct ctl *ctl, struct vec *peers, struct intf *node)
+{
+    struct peer *peer;
 
-    row++;
-    for (i = 0; i < ctl->n_group; i++) {
-        cur++;
-        row++;
-        intf = ctl->group[i].parent;
-        draw_intf(intf, row, 1, cur == ctl->cursor, 0);
-
-        for (j = 0; j < ctl->group[i].n_children; j++) {
-            cur++;
-            row++;
-            child = ctl->group[i].children[j];
-            draw_intf(child, row, 0,
-                cur == ctl->cursor,
-                j + 1 == ctl->group[i].n_children);
+    for (uint32_t i = 0; i < peers->length; i++) {
+        peer = vec_get(peers, i);
+        if (peer->node != node)
+            continue;
+        if (--peer->n_links == 0) {
+            /* sync_rows() lays the children out in this order */
+            vec_remove(peers, i);
+            pool_release(ctl->pool, peer, sizeof(struct peer));
         }
-
-        move(++row, 0);
-        clrtoeol();
+        return;
     }
+}
+
+/* a link joins the groups of its two nodes once both ends are known */
+static void link_connect(struct intf *link)
+{
+    struct intf *out = link->link.output_node_ref;
+    struct intf *in = link->link.input_node_ref;
 
-    clrtobot();
+    if (link->link.connected || out == NULL || in == NULL || out == in)
+        return;
 
-    refresh();
+    peer_add(link->ctl, &out->node.downstream, in);
+    peer_add(link->ctl, &in->node.upstream, out);
+    link->link.connected = true;
+    link->ctl->layout_dirty = true;
+    diff_link(link);
 }
 
-static void toggle_curnode_mute(struct ctl *ctl)
+static void link_disconnect(struct intf *link)
 {
-    struct intf *intf = find_curnode(ctl);
-    int mute;
+    struct intf *out = link->link.output_node_ref;
+    struct intf *in = link->link.input_node_ref;
 
-    if (intf->node.mute)
-        mute = 0;
-    else
-        mute = 1;
+    if (!link->link.connected)
+        return;
 
-    pw_thread_loop_lock(ctl->mainloop);
-    set_volume_mute(intf, NULL, &mute);
-    pw_thread_loop_unlock(ctl->mainloop);
+    peer_remove(link->ctl, &out->node.downstream, in);
+    peer_remove(link->ctl, &in->node.upstream, out);
+    link->link.connected = false;
+    link->ctl->layout_dirty = true;
+    diff_link(link);
 }
 
-static uint32_t set_curnode_volume(struct ctl *ctl, int volume, bool relative)
+static int add_row(struct ctl *ctl, struct intf *intf, uint32_t flags, int line)
 {
-    struct intf *intf = find_curnode(ctl);
-    struct volume vol;
+    struct row *rows;
+    uint32_t n;
+
+    if (ctl->n_rows == ctl->max_rows) {
+        n = ctl->max_rows ? ctl->max_rows * 2 : 64;
+        if ((rows = realloc(ctl->rows, n * sizeof(struct row))) == NULL)
+            return -ENOMEM;
+        ctl->rows = rows;
+        ctl->max_rows = n;
+    }
 
-    vol.n_channels = intf->node.channel_volume.n_channels;
-    for (uint32_t i = 0; i < vol.n_channels; i++) {
-        if (relative)
-            vol.values[i] = bound_int(volume + intf->node.channel_volume.values[i],
-                VOLUME_ZERO, VOLUME_MAX);
-        else
-            vol.values[i] = bound_int(volume, VOLUME_ZERO, VOLUME_MAX);
-    }
-
-    pw_thread_loop_lock(ctl->mainloop);
-    set_volume_mute(intf, &vol, NULL);
-    pw_thread_loop_unlock(ctl->mainloop);
+    ctl->rows[ctl->n_rows].intf = intf;
+    ctl->rows[ctl->n_rows].flags = flags;
+    ctl->rows[ctl->n_rows].line = line;
+    ctl->n_rows++;
+    return 0;
 }
 
-static void run_curses(struct ctl *ctl)
+/* flatten the groups of the current view into rows, only done when
+ * a node, a link or the view changed */
+static void sync_rows(struct ctl *ctl)
 {
-    int ch;
+    struct intf *intf;
+    struct vec *peers;
+    struct peer *peer;
+    uint32_t i;
+    int line = 0;
 
-    while ((ch = getch())) {
-        switch (ch) {
-        case 'j':
-        case KEY_DOWN:
-            ctl->cursor = (ctl->cursor + 1) % ctl->n_refs;
-            break;
-        case 'k':
-        case KEY_UP:
-            ctl->cursor = (ctl->cursor - 1 + ctl->n_refs) % ctl->n_refs;
-            break;
-        case 'h':
-        case KEY_LEFT:
-            set_curnode_volume(ctl, -((int)VOLUME_FULL / 100), true);
-            break;
-        case 'l':
-        case KEY_RIGHT:
-            set_curnode_volume(ctl, VOLUME_FULL / 100, true);
-            break;
-        case 'H':
-            set_curnode_volume(ctl, -((int)VOLUME_FULL / 10), true);
-            break;
-        case 'L':
-            set_curnode_volume(ctl, VOLUME_FULL / 10, true);
-            break;
-        case 'm':
-            toggle_curnode_mute(ctl);
-            break;
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-        {
-            uint32_t i = (ch - '0' + 9) % 10 + 1;
-            set_curnode_volume(ctl, VOLUME_FULL / 10 * i, false);
-            break;
-        }
-        case KEY_F(1):
-            ctl->node_flags = NODE_FLAG_SINK;
-            break;
-        case KEY_F(2):
-            ctl->node_flags = NODE_FLAG_SOURCE;
-            break;
-        case 'q':
-            ctl_pipewire_free(ctl);
-            return;
+    if (!ctl->layout_dirty)
+        return;
+    ctl->layout_dirty = false;
+
+    ctl->n_rows = 0;
+    spa_list_for_each(intf, &ctl->groups, node.group_link) {
+        if (!SPA_FLAG_IS_SET(intf->node.flags, ctl->node_flags))
+            continue;
+
+        add_row(ctl, intf, ROW_PARENT, line++);
+
+        if (cur_direction(ctl) == PW_DIRECTION_INPUT)
+            peers = &intf->node.upstream;
+        else
+            peers = &intf->node.downstream;
+        for (i = 0; i < peers->length; i++) {
+            peer = vec_get(peers, i);
+            add_row(ctl, peer->node,
+                i + 1 == peers->length ? ROW_END : 0, line++);
         }
 
-        redraw(ctl);
+        line++;
     }
+    ctl->n_lines = line;
 }
 
-/** node */
+/** redraw scheduling */
 
-static void parse_props(struct intf *intf, const struct spa_pod *param)
+/* called from the pipewire thread when a snapshot was published or a
+ * meter moved; only the first call after a repaint pokes the eventfd,
+ * the rest of the burst is folded into the same frame */
+static void schedule_redraw(struct ctl *ctl)
 {
-    struct ctl *ctl = intf->ctl;
-    struct spa_pod_prop *prop;
-    struct spa_pod_object *obj = (struct spa_pod_object*)param;
+    metrics_add(&ctl->metrics, METRIC_REDRAWS_REQUESTED, 1);
+    if (__atomic_exchange_n(&ctl->dirty, 1, __ATOMIC_ACQ_REL) == 0 && ctl->fd >= 0)
+        spa_system_eventfd_write(ctl->system, ctl->fd, 1);
+}
 
-    SPA_POD_OBJECT_FOREACH(obj, prop) {
-        switch (prop->key) {
-        case SPA_PROP_volume:
-            if (spa_pod_get_float(&prop->value, &intf->node.volume) < 0)
-                continue;
-            log_debug("update node#%d volume", intf->id);
-            break;
-        case SPA_PROP_mute:
-            if (spa_pod_get_bool(&prop->value, &intf->node.mute) < 0)
-                continue;
-            log_debug("update node#%d mute", intf->id);
-            break;
-        case SPA_PROP_channelVolumes:
-        {
-            float channels[SPA_AUDIO_MAX_CHANNELS];
-            uint32_t n_channels, i;
+/* milliseconds until the next frame may be drawn */
+static int frame_timeout(struct ctl *ctl)
+{
+    uint64_t elapsed = get_time_ns() - ctl->last_frame;
 
-            n_channels = spa_pod_copy_array(&prop->value, SPA_TYPE_Float,
-                channels, SPA_AUDIO_MAX_CHANNELS);
+    if (elapsed >= ctl->frame_interval)
+        return 0;
+    return (ctl->frame_interval - elapsed + SPA_NSEC_PER_MSEC - 1) / SPA_NSEC_PER_MSEC;
+}
 
-            intf->node.channel_volume.n_channels = n_channels;
-            for (i = 0; i < n_channels; i++)
-                intf->node.channel_volume.values[i] =
-                    volume_from_linear(channels[i], ctl->volume_method);
+/** snapshot */
 
-            log_debug("update node#%d channelVolumes", intf->id);
-            break;
-        }
-        default:
-            break;
-        }
-    }
+static int snapshot_name(struct snapshot *snap, struct intf *intf)
+{
+    char name[256], *names;
+    uint32_t offset = snap->names_len, size;
+    int len;
 
-    redraw(ctl);
+    if (spa_atob(intf_prop(intf, PROP_NODE_VIRTUAL)))
+        len = snprintf(name, sizeof(name), "%s",
+            intf_prop(intf, PROP_NODE_NAME));
+    else if (intf->node.flags & NODE_FLAG_STREAM)
+        len = snprintf(name, sizeof(name), "%s: %s",
+            intf_prop(intf, PROP_NODE_NAME),
+            intf_prop(intf, PROP_MEDIA_NAME));
+    else
+        len = snprintf(name, sizeof(name), "%s",
+            intf_prop(intf, PROP_NODE_NAME));
+    len = SPA_MIN(len, (int)sizeof(name) - 1) + 1;
+
+    if (offset + len > snap->names_size) {
+        size = snap->names_size ? snap->names_size : 4096;
+        while (offset + len > size)
+            size *= 2;
+        if ((names = realloc(snap->names, size)) == NULL)
+            return -ENOMEM;
+        snap->names = names;
+        snap->names_size = size;
+    }
+    memcpy(snap->names + offset, name, len);
+    snap->names_len += len;
+    return offset;
 }
 
-static void node_event_info(void *data, const struct pw_node_info *info)
+static int build_snapshot(struct ctl *ctl, struct snapshot *snap)
 {
-    struct intf *intf = data;
+    struct snap_row *rows, *r;
+    struct intf *intf;
     const char *str;
     uint32_t i;
+    int res;
 
-    if (info->change_mask & PW_NODE_CHANGE_MASK_PROPS && info->props) {
-        if ((str = spa_dict_lookup(info->props, "card.profile.device")))
-            intf->node.profile_device_id = atoi(str);
-        else
-            intf->node.profile_device_id = SPA_ID_INVALID;
+    if (snap->max_rows < ctl->n_rows) {
+        if ((rows = realloc(snap->rows, ctl->n_rows * sizeof(*rows))) == NULL)
+            return -ENOMEM;
+        snap->rows = rows;
+        snap->max_rows = ctl->n_rows;
+    }
 
-        if ((str = spa_dict_lookup(info->props, PW_KEY_DEVICE_ID)))
-            intf->node.device_id = atoi(str);
-        else
-            intf->node.device_id = SPA_ID_INVALID;
+    snap->names_len = 0;
+    for (i = 0; i < ctl->n_rows; i++) {
+        intf = ctl->rows[i].intf;
+        r = &snap->rows[i];
+        r->id = intf->id;
+        r->flags = ctl->rows[i].flags;
+        r->line = ctl->rows[i].line;
+        r->volume = lroundf((float)intf->node.channel_volume.values[0] / VOLUME_FULL * 100);
+        r->meter = intf->node.meter;
+
+        if (intf->node.mute)
+            r->flags |= ROW_MUTE;
+        if ((str = intf_prop(intf, PROP_NODE_NAME)) &&
+            (spa_streq(str, ctl->default_sink) || spa_streq(str, ctl->default_source)))
+            r->flags |= ROW_DEFAULT;
+
+        if ((res = snapshot_name(snap, intf)) < 0)
+            return res;
+        r->name = res;
+    }
+    snap->n_rows = ctl->n_rows;
+    snap->n_lines = ctl->n_lines;
+    return 0;
+}
 
-        if ((str = spa_dict_lookup(info->props, PW_KEY_MEDIA_CLASS))) {
-            if (spa_streq(str, "Audio/Sink"))
-                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_SINK);
-            else if (spa_streq(str, "Audio/Source"))
-                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_SOURCE);
-            else if (spa_streq(str, "Stream/Output/Audio"))
-                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_OUTPUT | NODE_FLAG_STREAM);
-            else if (spa_streq(str, "Stream/Input/Audio"))
-                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_INPUT | NODE_FLAG_STREAM);
-        }
+/* rebuild the back snapshot from the model and swap it into the middle
+ * slot, the one the ui had there before becomes the new back */
+static void publish_snapshot(struct ctl *ctl)
+{
+    struct snapshot *snap = &ctl->snapshots[ctl->snap_back];
+    int res;
 
-        pw_properties_update(intf->props, info->props);
+    ctl->publish_pending = false;
+    ctl->last_publish = get_time_ns();
 
-        log_debug("node#%d: device_id:%d profile_device_id:%d", intf->id,
-            intf->node.device_id, intf->node.profile_device_id);
+    sync_rows(ctl);
+    if ((res = build_snapshot(ctl, snap)) < 0) {
+        log_error("cannot build snapshot: %s", spa_strerror(res));
+        return;
     }
-    if (info->change_mask & PW_NODE_CHANGE_MASK_PARAMS) {
-        for (i = 0; i < info->n_params; i++) {
-            if (!(info->params[i].flags & SPA_PARAM_INFO_READ))
-                continue;
 
-            switch (info->params[i].id) {
-            case SPA_PARAM_Props:
-                pw_node_enum_params(intf->proxy,
-                    0, info->params[i].id, 0, -1, NULL);
-                break;
-            default:
-                break;
-            }
-        }
-    }
+    ctl->snap_back = __atomic_exchange_n(&ctl->snap_middle,
+        ctl->snap_back | SNAPSHOT_FRESH, __ATOMIC_ACQ_REL) & SNAPSHOT_INDEX;
+    schedule_redraw(ctl);
 }
 
-static void node_event_param(void *data, int seg,
-    uint32_t id, uint32_t index, uint32_t next,
-    const struct spa_pod *param)
+static void on_publish_timeout(void *data, uint64_t expirations)
 {
-    struct intf *intf = data;
-
-    switch (id) {
-    case SPA_PARAM_Props:
-        parse_props(intf, param);
-        break;
-    default:
-        break;
-    }
+    publish_snapshot(data);
 }
 
-static void node_event_init(void *data)
+/* called from the pipewire thread whenever something on display changed,
+ * a burst of events is folded into one snapshot per frame; without a
+ * loop the snapshot is built on the next ctl_screen_render */
+static void schedule_publish(struct ctl *ctl)
 {
-    struct intf *intf = data;
+    uint64_t elapsed, delay = 0;
+    struct timespec value;
+
+    if (ctl->publish_pending)
+        return;
+    ctl->publish_pending = true;
+    if (ctl->publish_timer == NULL)
+        return;
+
+    elapsed = get_time_ns() - ctl->last_publish;
+    if (elapsed < ctl->frame_interval)
+        delay = ctl->frame_interval - elapsed;
 
-    intf->node.ports = array_new(sizeof(struct intf*));
-    intf->node.links = array_new(sizeof(struct intf*));
+    /* a zero timeout would disarm the timer */
+    value.tv_sec = delay / SPA_NSEC_PER_SEC;
+    value.tv_nsec = SPA_MAX(delay % SPA_NSEC_PER_SEC, 1u);
+    pw_loop_update_timer(ctl->loop, ctl->publish_timer, &value, NULL, false);
 }
 
-static void node_event_destroy(void *data)
+/* take the latest published snapshot if there is one, wait-free; returns
+ * true when the snapshot to draw changed */
+static bool acquire_snapshot(struct ctl *ctl)
 {
-    struct intf *intf = data, *target;
-    int i;
+    if (!(__atomic_load_n(&ctl->snap_middle, __ATOMIC_ACQUIRE) & SNAPSHOT_FRESH))
+        return false;
+    ctl->snap_front = __atomic_exchange_n(&ctl->snap_middle,
+        ctl->snap_front, __ATOMIC_ACQ_REL) & SNAPSHOT_INDEX;
+    return true;
+}
 
-    log_debug("node destroy");
+static struct snapshot *ui_snapshot(struct ctl *ctl)
+{
+    return &ctl->snapshots[ctl->snap_front];
+}
 
-    for (i = 0; i < intf->node.ports->length; i++) {
-        target = array_get(intf->node.ports, i);
-        target->port.node = SPA_ID_INVALID;
-        target->port.node_ref = NULL;
-    }
-    array_free(intf->node.ports);
-    intf->node.ports = NULL;
+/* the node under the cursor on screen, looked up again in the model as
+ * it may be gone by now; must be called with the thread loop locked */
+static struct intf *find_curnode(struct ctl *ctl)
+{
+    struct snapshot *snap = ui_snapshot(ctl);
 
-    for (i = 0; i < intf->node.links->length; i++) {
-        target = array_get(intf->node.links, i);
-        if (intf->id == target->link.output_node) {
-            target->link.output_node = SPA_ID_INVALID;
-            target->link.output_node_ref = NULL;
-        } else {
-            target->link.input_node = SPA_ID_INVALID;
-            target->link.input_node_ref = NULL;
-        }
-    }
-    array_free(intf->node.links);
-    intf->node.links = NULL;
+    if (ctl->cursor >= snap->n_rows)
+        return NULL;
+    return find_node(ctl, snap->rows[ctl->cursor].id, NULL, PW_TYPE_INTERFACE_Node);
 }
 
-static const struct pw_node_events node_events = {
-    PW_VERSION_NODE_EVENTS,
-    .info = node_event_info,
-    .param = node_event_param,
-};
-
-static const struct intf_info node_info = {
-    .type = PW_TYPE_INTERFACE_Node,
-    .version = PW_VERSION_NODE,
-    .events = &node_events,
-    .init = node_event_init,
-    .destroy = node_event_destroy,
-};
+/** json */
 
-/** device */
+static const char *node_class(struct intf *intf)
+{
+    if (!spa_streq(intf->info->type, PW_TYPE_INTERFACE_Node))
+        return NULL;
+    if (intf->node.flags & NODE_FLAG_SINK)
+        return "sink";
+    if (intf->node.flags & NODE_FLAG_SOURCE)
+        return "source";
+    if (intf->node.flags & NODE_FLAG_OUTPUT)
+        return "output";
+    if (intf->node.flags & NODE_FLAG_INPUT)
+        return "input";
+    return NULL;
+}
 
-static void device_event_info(void *data, const struct pw_device_info *info)
+static void print_json_string(FILE *out, const char *str)
 {
-    struct intf *intf = data;
-    uint32_t i;
+    fputc('"', out);
+    for (; str != NULL && *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(out, "\\u%04x", *str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
 
-    if (info->change_mask & PW_DEVICE_CHANGE_MASK_PARAMS) {
-        for (i = 0; i < info->n_params; i++) {
-            if (!(info->params[i].flags & SPA_PARAM_INFO_READ))
-                continue;
+/* staged changes are shown, so a read right after a change sees it
+ * before the server acknowledged it */
+static void print_node(struct ctl *ctl, FILE *out, struct intf *intf, bool json)
+{
+    const char *name = intf_prop(intf, PROP_NODE_NAME);
+    const char *media = intf_prop(intf, PROP_MEDIA_NAME);
+    bool is_default;
+    int volume, mute;
+
+    is_default = name != NULL &&
+        (spa_streq(name, ctl->default_sink) || spa_streq(name, ctl->default_source));
+    volume = lroundf((float)queued_volume(intf)->values[0] / VOLUME_FULL * 100);
+    mute = intf->node.pending.has_mute ? intf->node.pending.mute : intf->node.mute;
+
+    if (!json) {
+        fprintf(out, "%c %5u %-6s %4d%% %c %s%s%s\n",
+            is_default ? '*' : ' ', intf->id, node_class(intf), volume,
+            mute ? 'M' : ' ', name ? name : "",
+            media ? ": " : "", media ? media : "");
+        return;
+    }
 
-            switch (info->params[i].id) {
-            case SPA_PARAM_Route:
-                pw_device_enum_params((struct pw_device*)intf->proxy,
-                    0, info->params[i].id, 0, -1, NULL);
-                break;
-            default:
-                break;
-            }
-        }
+    fprintf(out, "{\"id\":%u,\"class\":\"%s\",\"name\":", intf->id, node_class(intf));
+    print_json_string(out, name);
+    if (media != NULL) {
+        fputs(",\"media\":", out);
+        print_json_string(out, media);
     }
+    fprintf(out, ",\"volume\":%d,\"mute\":%s,\"default\":%s}",
+        volume, mute ? "true" : "false", is_default ? "true" : "false");
 }
 
-static void device_event_param(void *data, int seg,
-    uint32_t id, uint32_t index, uint32_t next,
-    const struct spa_pod *param)
+static void print_nodes(struct ctl *ctl, FILE *out, bool json)
 {
-    struct intf *intf = data;
+    struct intf *intf;
+    bool first = true;
 
-    switch (id) {
-    case SPA_PARAM_Route:
-    {
-        uint32_t id, device_id;
-        enum spa_direction direction;
-        struct spa_pod *props = NULL;
+    if (json)
+        fputc('[', out);
+    spa_list_for_each(intf, &ctl->refs, ref) {
+        if (node_class(intf) == NULL)
+            continue;
+        if (json && !first)
+            fputc(',', out);
+        print_node(ctl, out, intf, json);
+        first = false;
+    }
+    if (json)
+        fputs("]\n", out);
+}
 
-        if (spa_pod_parse_object(param,
-            SPA_TYPE_OBJECT_ParamRoute, NULL,
-            SPA_PARAM_ROUTE_index, SPA_POD_Int(&id),
-            SPA_PARAM_ROUTE_direction, SPA_POD_Id(&direction),
-            SPA_PARAM_ROUTE_device, SPA_POD_Int(&device_id),
-            SPA_PARAM_ROUTE_props, SPA_POD_OPT_Pod(&props)) < 0)
-        {
-            return;
-        }
+/* -1 until the first Props param came in */
+static int node_volume(struct intf *intf)
+{
+    if (intf->node.channel_volume.n_channels == 0)
+        return -1;
+    return lroundf((float)intf->node.channel_volume.values[0] / VOLUME_FULL * 100);
+}
 
-        if (direction == SPA_DIRECTION_OUTPUT)
-            intf->device.active_route_output = id;
-        else
-            intf->device.active_route_input = id;
+/* the first event of a node carries everything known about it, the
+ * ones after it only what changed */
+static void print_added(FILE *out, struct intf *intf)
+{
+    const char *media = intf_prop(intf, PROP_MEDIA_NAME);
+
+    fprintf(out, "{\"event\":\"add\",\"id\":%u,\"class\":\"%s\",\"name\":",
+        intf->id, node_class(intf));
+    print_json_string(out, intf_prop(intf, PROP_NODE_NAME));
+    if (media != NULL) {
+        fputs(",\"media\":", out);
+        print_json_string(out, media);
+    }
+    if (intf->node.shown.volume >= 0)
+        fprintf(out, ",\"volume\":%d", intf->node.shown.volume);
+    if (intf->node.shown.mute >= 0)
+        fprintf(out, ",\"mute\":%s", intf->node.shown.mute ? "true" : "false");
+    fputs("}\n", out);
+}
 
-        log_debug("device#%d: active %s route id:%d device:%d", intf->id,
-            direction == SPA_DIRECTION_OUTPUT ? "output" : "input",
-            id, device_id);
+static void print_link(FILE *out, struct intf *link)
+{
+    if (link->link.connected)
+        fprintf(out, "{\"event\":\"link\",\"id\":%u,\"output\":%u,\"input\":%u}\n",
+            link->id, link->link.output_node, link->link.input_node);
+    else
+        fprintf(out, "{\"event\":\"unlink\",\"id\":%u}\n", link->id);
+}
 
-        if (props != NULL)
-            parse_props(intf, props);
+/** daemon */
 
-        break;
+static struct intf *find_target(struct ctl *ctl, const char *target)
+{
+    unsigned long id;
+    char *end;
+
+    if (target == NULL || spa_streq(target, SCRIPT_DEFAULT_SINK)) {
+        target = ctl->default_sink;
+    } else if (spa_streq(target, SCRIPT_DEFAULT_SOURCE)) {
+        target = ctl->default_source;
+    } else {
+        id = strtoul(target, &end, 10);
+        if (end != target && *end == '\0')
+            return find_node(ctl, id, NULL, PW_TYPE_INTERFACE_Node);
     }
+    return find_node(ctl, SPA_ID_INVALID, target, NULL);
+}
+
+static const char *command_error(int res)
+{
+    switch (res) {
+    case -ENOENT:
+        return "no such node";
+    case -ENOTSUP:
+        return "node has no volume";
+    case -EPERM:
+        return "not allowed to change the node";
     default:
-        break;
+        return spa_strerror(res);
     }
 }
 
-static const struct pw_device_events device_events = {
-    PW_VERSION_DEVICE_EVENTS,
-    .info = device_event_info,
-    .param = device_event_param,
-};
+/* must be called with the thread loop locked; list and get print to out,
+ * changes are only staged and go out with the next flush_pending() */
+static int apply_command(struct ctl *ctl, struct script_command *command, FILE *out)
+{
+    struct intf *intf;
+    struct volume *cur, vol;
+    int mute, step;
 
-static const struct intf_info device_info = {
-    .type = PW_TYPE_INTERFACE_Device,
-    .version = PW_VERSION_DEVICE,
-    .events = &device_events,
-};
+    if (command->op == SCRIPT_LIST) {
+        print_nodes(ctl, out, command->json);
+        return 0;
+    }
 
-/** metadata */
+    if ((intf = find_target(ctl, command->target)) == NULL ||
+        intf->proxy == NULL || node_class(intf) == NULL)
+        return -ENOENT;
 
-static int metadata_event_property(void *data, uint32_t subject,
-    const char *key, const char *type, const char *value)
+    if (command->op == SCRIPT_GET) {
+        print_node(ctl, out, intf, true);
+        fputc('\n', out);
+        return 0;
+    }
+
+    if (!can_set_volume(intf))
+        return -EPERM;
+
+    if (command->op == SCRIPT_MUTE) {
+        if (command->mute >= 0)
+            mute = command->mute;
+        else if (intf->node.pending.has_mute)
+            mute = !intf->node.pending.mute;
+        else
+            mute = !intf->node.mute;
+        stage_volume_mute(intf, NULL, &mute);
+        return 0;
+    }
+
+    /* steps add up on top of the ones staged before them */
+    cur = queued_volume(intf);
+    if (cur->n_channels == 0)
+        return -ENOTSUP;
+    step = command->volume * (int)VOLUME_FULL / 100;
+    vol.n_channels = cur->n_channels;
+    for (uint32_t i = 0; i < vol.n_channels; i++)
+        vol.values[i] = bound_int(command->relative ? (int)cur->values[i] + step : step,
+            VOLUME_ZERO, VOLUME_MAX);
+    /* an explicit level wins over a running fade and the level 'f' saved */
+    cancel_fade(intf);
+    intf->node.fade_level.n_channels = 0;
+    stage_volume_mute(intf, &vol, NULL);
+    return 0;
+}
+
+static void close_client(struct client *client)
+{
+    struct ctl *ctl = client->ctl;
+
+    if (client->subscribed)
+        ctl->n_subscribers--;
+    spa_list_remove(&client->link);
+    pw_loop_destroy_source(ctl->loop, client->source);
+    free(client->out);
+    free(client);
+}
+
+/* write what the socket takes now, the rest waits for SPA_IO_OUT */
+static int flush_client(struct client *client)
+{
+    size_t done = 0;
+    uint32_t mask;
+    ssize_t n;
+
+    while (done < client->out_len) {
+        n = send(client->fd, client->out + done, client->out_len - done,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n < 0)
+            return -errno;
+        done += n;
+    }
+    client->out_len -= done;
+    memmove(client->out, client->out + done, client->out_len);
+
+    /* a subscriber may have shut down its side and still listen */
+    if (client->eof && client->out_len == 0 && !client->subscribed)
+        return -EPIPE;
+    mask = (client->eof ? 0 : SPA_IO_IN) | (client->out_len > 0 ? SPA_IO_OUT : 0);
+    if (mask != client->mask) {
+        client->mask = mask;
+        pw_loop_update_io(client->ctl->loop, client->source, mask);
+    }
+    return 0;
+}
+
+/* a client that lets CLIENT_MAX_OUT pile up is dropped rather than
+ * buffered without bound */
+static int client_send(struct client *client, const char *data, size_t len)
+{
+    size_t size;
+    char *out;
+
+    if (client->out_len + len > CLIENT_MAX_OUT)
+        return -ENOBUFS;
+    if (client->out_len + len > client->out_size) {
+        size = client->out_size ? client->out_size : 4096;
+        while (client->out_len + len > size)
+            size *= 2;
+        if ((out = realloc(client->out, size)) == NULL)
+            return -ENOMEM;
+        client->out = out;
+        client->out_size = size;
+    }
+    memcpy(client->out + client->out_len, data, len);
+    client->out_len += len;
+    return flush_client(client);
+}
+
+static bool watching(struct ctl *ctl);
+static void on_events_flush(void *data, uint64_t count);
+
+/* a new subscriber starts from the whole graph as add and link events,
+ * which is also what every event after it is a diff against. the shown
+ * state is shared by all of them: while others watch it is what they
+ * were told and the snapshot repeats it, else it is stale and is brought
+ * up to date first */
+static void print_state(struct ctl *ctl, FILE *out, bool sync)
+{
+    struct intf *intf;
+
+    spa_list_for_each(intf, &ctl->refs, ref) {
+        if (node_class(intf) != NULL) {
+            if (sync) {
+                intf->node.shown.added = true;
+                intf->node.shown.volume = node_volume(intf);
+                intf->node.shown.mute = intf->node.shown.volume < 0 ? -1 : intf->node.mute;
+            }
+            if (intf->node.shown.added)
+                print_added(out, intf);
+        } else if (spa_streq(intf->info->type, PW_TYPE_INTERFACE_Link)) {
+            if (sync)
+                intf->link.shown = intf->link.connected;
+            if (intf->link.shown)
+                print_link(out, intf);
+        }
+    }
+    fputs("{\"event\":\"default\",\"sink\":", out);
+    print_json_string(out, ctl->default_sink);
+    fputs(",\"source\":", out);
+    print_json_string(out, ctl->default_source);
+    fputs("}\n", out);
+}
+
+/* every request gets one line back, subscribe also gets the graph */
+static int handle_request(struct client *client, char *line)
+{
+    struct ctl *ctl = client->ctl;
+    struct script_command command;
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *out;
+    int res;
+
+    if ((out = open_memstream(&buf, &len)) == NULL)
+        return -ENOMEM;
+
+    if (strcmp(line, "subscribe") == 0) {
+        /* the queued events are diffs against what was shown before the
+         * snapshot, send them to the others so it comes after them */
+        on_events_flush(ctl, 0);
+        fputs("{\"ok\":true}\n", out);
+        print_state(ctl, out, !watching(ctl));
+        if (!client->subscribed)
+            ctl->n_subscribers++;
+        client->subscribed = true;
+    } else if ((res = script_parse_line(&command, line)) < 0) {
+        fputs("{\"error\":\"invalid command\"}\n", out);
+    } else if (res > 0) {
+        command.json = true;
+        if ((res = apply_command(ctl, &command, out)) < 0) {
+            fputs("{\"error\":", out);
+            print_json_string(out, command_error(res));
+            fputs("}\n", out);
+        } else if (command.op == SCRIPT_SET_VOLUME || command.op == SCRIPT_MUTE) {
+            fputs("{\"ok\":true}\n", out);
+        }
+        script_command_clear(&command);
+    }
+
+    fclose(out);
+    res = len > 0 ? client_send(client, buf, len) : 0;
+    free(buf);
+    return res;
+}
+
+static void on_client_io(void *data, int fd, uint32_t mask)
+{
+    struct client *client = data;
+    struct ctl *ctl = client->ctl;
+    char *line, *end;
+    ssize_t n;
+
+    if ((client->eof && mask & (SPA_IO_HUP | SPA_IO_ERR)) ||
+        (mask & SPA_IO_OUT && flush_client(client) < 0)) {
+        close_client(client);
+        return;
+    }
+
+    while (mask & (SPA_IO_IN | SPA_IO_HUP | SPA_IO_ERR) && !client->eof) {
+        n = recv(fd, client->in + client->in_len,
+            sizeof(client->in) - 1 - client->in_len, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n <= 0) {
+            /* a last line without a newline still counts */
+            client->eof = true;
+            client->in[client->in_len++] = '\n';
+        } else {
+            client->in_len += n;
+        }
+        client->in[client->in_len] = '\0';
+
+        for (line = client->in; (end = strchr(line, '\n')) != NULL; line = end + 1) {
+            *end = '\0';
+            if (handle_request(client, line) < 0) {
+                close_client(client);
+                goto done;
+            }
+        }
+        client->in_len -= line - client->in;
+        memmove(client->in, line, client->in_len);
+        if (client->in_len == sizeof(client->in) - 1) {
+            close_client(client);
+            goto done;
+        }
+    }
+    /* close once everything that was asked for went out */
+    if (client->eof && flush_client(client) < 0)
+        close_client(client);
+done:
+    flush_pending(ctl);
+}
+
+static void on_accept(void *data, int fd, uint32_t mask)
+{
+    struct ctl *ctl = data;
+    struct client *client;
+    int cfd;
+
+    if ((cfd = accept(fd, NULL, NULL)) < 0)
+        return;
+    fcntl(cfd, F_SETFD, FD_CLOEXEC);
+    fcntl(cfd, F_SETFL, O_NONBLOCK);
+    if ((client = calloc(1, sizeof(struct client))) == NULL) {
+        close(cfd);
+        return;
+    }
+    client->ctl = ctl;
+    client->fd = cfd;
+    client->mask = SPA_IO_IN;
+    client->source = pw_loop_add_io(ctl->loop, cfd, SPA_IO_IN, true,
+        on_client_io, client);
+    if (client->source == NULL) {
+        close(cfd);
+        free(client);
+        return;
+    }
+    spa_list_append(&ctl->clients, &client->link);
+}
+
+static void notify(struct ctl *ctl, const char *buf, size_t len)
+{
+    struct client *client, *tmp;
+
+    spa_list_for_each_safe(client, tmp, &ctl->clients, link) {
+        if (client->subscribed && client_send(client, buf, len) < 0)
+            close_client(client);
+    }
+}
+
+/* must be called with the thread loop locked */
+static int open_daemon(struct ctl *ctl, const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd, probe, res;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -ENAMETOOLONG;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+        return -errno;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        /* an unbound socket would listen on an autobound abstract
+         * address nobody knows */
+        if (errno != EADDRINUSE)
+            goto error;
+        /* take the path over from a daemon that is gone, not a live one */
+        if ((probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0) {
+            res = connect(probe, (struct sockaddr*)&addr, sizeof(addr));
+            if (res < 0 && errno == ECONNREFUSED)
+                unlink(path);
+            close(probe);
+        }
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+            goto error;
+    }
+    /* from here on the path is ours and must not outlive a failure */
+    if (listen(fd, 16) < 0)
+        goto error_unlink;
+
+    ctl->listen_source = pw_loop_add_io(ctl->loop, fd, SPA_IO_IN, true, on_accept, ctl);
+    if (ctl->listen_source == NULL)
+        goto error_unlink;
+    snprintf(ctl->socket_path, sizeof(ctl->socket_path), "%s", path);
+    return 0;
+
+error_unlink:
+    res = -errno;
+    unlink(path);
+    close(fd);
+    return res;
+error:
+    res = -errno;
+    close(fd);
+    return res;
+}
+
+static void close_daemon(struct ctl *ctl)
+{
+    struct client *client;
+
+    spa_list_consume(client, &ctl->clients, link)
+        close_client(client);
+    if (ctl->listen_source == NULL)
+        return;
+    pw_loop_destroy_source(ctl->loop, ctl->listen_source);
+    ctl->listen_source = NULL;
+    unlink(ctl->socket_path);
+}
+
+/** events */
+
+/* --watch and daemon subscribers get one line per change of what the
+ * mixer shows, as a diff against the lines written before */
+static bool watching(struct ctl *ctl)
+{
+    return ctl->watch || ctl->n_subscribers > 0;
+}
+
+/* lines pile up while the loop dispatches and are written together from
+ * on_events_flush() once it is done */
+static void emit_event(struct ctl *ctl, const char *line, size_t len)
+{
+    size_t size;
+    char *events;
+
+    if (ctl->events_len + len > ctl->events_size) {
+        size = ctl->events_size ? ctl->events_size : 4096;
+        while (ctl->events_len + len > size)
+            size *= 2;
+        if ((events = realloc(ctl->events, size)) == NULL) {
+            log_warn("dropped event: %.*s", (int)len - 1, line);
+            return;
+        }
+        ctl->events = events;
+        ctl->events_size = size;
+    }
+    if (ctl->events_len == 0 && ctl->events_source != NULL)
+        pw_loop_signal_event(ctl->loop, ctl->events_source);
+    memcpy(ctl->events + ctl->events_len, line, len);
+    ctl->events_len += len;
+}
+
+static void on_events_flush(void *data, uint64_t count)
+{
+    struct ctl *ctl = data;
+
+    if (ctl->events_len == 0)
+        return;
+    if (ctl->watch) {
+        fwrite(ctl->events, 1, ctl->events_len, stdout);
+        fflush(stdout);
+    }
+    notify(ctl, ctl->events, ctl->events_len);
+    ctl->events_len = 0;
+}
+
+static void diff_node(struct intf *intf)
+{
+    struct ctl *ctl = intf->ctl;
+    char line[128], *buf = NULL;
+    size_t len = 0;
+    int volume, mute, n;
+    FILE *out;
+
+    if (!watching(ctl) || node_class(intf) == NULL)
+        return;
+
+    volume = node_volume(intf);
+    mute = volume < 0 ? -1 : intf->node.mute;
+
+    if (!intf->node.shown.added) {
+        intf->node.shown.added = true;
+        intf->node.shown.volume = volume;
+        intf->node.shown.mute = mute;
+        if ((out = open_memstream(&buf, &len)) == NULL)
+            return;
+        print_added(out, intf);
+        fclose(out);
+        emit_event(ctl, buf, len);
+        free(buf);
+        return;
+    }
+
+    if (volume != intf->node.shown.volume) {
+        intf->node.shown.volume = volume;
+        n = snprintf(line, sizeof(line),
+            "{\"event\":\"volume\",\"id\":%u,\"volume\":%d}\n", intf->id, volume);
+        emit_event(ctl, line, n);
+    }
+    if (mute != intf->node.shown.mute) {
+        intf->node.shown.mute = mute;
+        n = snprintf(line, sizeof(line),
+            "{\"event\":\"mute\",\"id\":%u,\"mute\":%s}\n", intf->id,
+            mute ? "true" : "false");
+        emit_event(ctl, line, n);
+    }
+}
+
+static void diff_node_removed(struct intf *intf)
+{
+    char line[64];
+    int n;
+
+    if (!watching(intf->ctl) || !intf->node.shown.added)
+        return;
+    intf->node.shown.added = false;
+    n = snprintf(line, sizeof(line), "{\"event\":\"remove\",\"id\":%u}\n", intf->id);
+    emit_event(intf->ctl, line, n);
+}
+
+static void diff_link(struct intf *link)
+{
+    char line[128];
+    FILE *out;
+
+    if (!watching(link->ctl) || link->link.connected == link->link.shown)
+        return;
+    link->link.shown = link->link.connected;
+    if ((out = fmemopen(line, sizeof(line), "w")) == NULL)
+        return;
+    print_link(out, link);
+    fclose(out);
+    emit_event(link->ctl, line, strlen(line));
+}
+
+/* which is "sink" or "source", called before the new name is stored;
+ * name is NULL when the default was cleared */
+static void diff_default(struct ctl *ctl, const char *which,
+    const char *old_name, const char *name)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *out;
+
+    if (!watching(ctl) || spa_streq(old_name, name) ||
+        (out = open_memstream(&buf, &len)) == NULL)
+        return;
+    fprintf(out, "{\"event\":\"default\",\"%s\":", which);
+    if (name != NULL)
+        print_json_string(out, name);
+    else
+        fputs("null", out);
+    fputs("}\n", out);
+    fclose(out);
+    emit_event(ctl, buf, len);
+    free(buf);
+}
+
+/** metrics */
+
+static int read_wchar(int tid, uint64_t *wchar)
+{
+    char path[64], line[128];
+    FILE *file;
+    int res = -ENOENT;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/io", tid);
+    if ((file = fopen(path, "r")) == NULL)
+        return -errno;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "wchar: %" SCNu64, wchar) == 1) {
+            res = 0;
+            break;
+        }
+    }
+    fclose(file);
+    return res;
+}
+
+/* curses writes to the terminal by itself, what the thread running it
+ * wrote since the screen was opened is taken as the terminal output */
+static void update_terminal_bytes(struct ctl *ctl)
+{
+    int tid = __atomic_load_n(&ctl->screen_tid, __ATOMIC_ACQUIRE);
+    uint64_t wchar;
+
+    if (tid != 0 && read_wchar(tid, &wchar) == 0)
+        metrics_set(&ctl->metrics, METRIC_TERMINAL_BYTES, wchar - ctl->screen_wchar);
+}
+
+static void write_metrics(struct ctl *ctl)
+{
+    int res;
+
+    update_terminal_bytes(ctl);
+    if ((res = metrics_write(&ctl->metrics, ctl->metrics_path)) < 0)
+        log_warn("cannot write metrics to %s: %s", ctl->metrics_path,
+            spa_strerror(res));
+}
+
+static void on_metrics_timeout(void *data, uint64_t expirations)
+{
+    write_metrics(data);
+}
+
+/** meters */
+
+static void meter_process(void *data)
+{
+    struct meter *meter = data;
+    struct pw_buffer *b;
+    struct spa_data *d;
+    float peak = 0.0f, sum_sq = 0.0f, rms;
+    uint32_t offs, n, n_samples = 0;
+
+    while ((b = pw_stream_dequeue_buffer(meter->stream)) != NULL) {
+        d = &b->buffer->datas[0];
+        if (d->data != NULL && d->chunk != NULL) {
+            offs = SPA_MIN(d->chunk->offset, d->maxsize);
+            n = SPA_MIN(d->chunk->size, d->maxsize - offs) / sizeof(float);
+            dsp_level(SPA_PTROFF(d->data, offs, const float), n, &peak, &sum_sq);
+            n_samples += n;
+        }
+        pw_stream_queue_buffer(meter->stream, b);
+    }
+    if (n_samples == 0)
+        return;
+
+    rms = sqrtf(sum_sq / n_samples);
+    __atomic_store(&meter->peak, &peak, __ATOMIC_RELAXED);
+    __atomic_store(&meter->rms, &rms, __ATOMIC_RELAXED);
+    schedule_redraw(meter->ctl);
+}
+
+static const struct pw_stream_events meter_events = {
+    PW_VERSION_STREAM_EVENTS,
+    .process = meter_process,
+};
+
+static bool meter_wanted(struct intf *intf)
+{
+    return intf->node.flags & (NODE_FLAG_SINK | NODE_FLAG_SOURCE | NODE_FLAG_OUTPUT);
+}
+
+/* streams are created once per pool slot and only reconnected to a
+ * new target when the slot changes hands */
+static struct pw_stream *meter_stream(struct meter *meter)
+{
+    struct ctl *ctl = meter->ctl;
+    struct pw_properties *props;
+
+    if (meter->stream != NULL)
+        return meter->stream;
+
+    /* a mono stream at a low rate in small quanta keeps the per node
+     * cost down, the adapter downmixes and resamples for us */
+    props = pw_properties_new(
+        PW_KEY_MEDIA_TYPE, "Audio",
+        PW_KEY_MEDIA_CATEGORY, "Monitor",
+        PW_KEY_NODE_NAME, METER_NODE_NAME,
+        PW_KEY_NODE_LATENCY, METER_LATENCY,
+        PW_KEY_STREAM_MONITOR, "true",
+        PW_KEY_NODE_PASSIVE, "true",
+        PW_KEY_NODE_DONT_RECONNECT, "true",
+        NULL);
+
+    if ((meter->stream = pw_stream_new(ctl->core, "pwmixer meter", props)) != NULL)
+        pw_stream_add_listener(meter->stream, &meter->listener, &meter_events, meter);
+    return meter->stream;
+}
+
+/* must be called with the thread loop locked */
+static int attach_meter(struct meter *meter, struct intf *intf)
+{
+    struct pw_stream *stream;
+    const char *str;
+    uint8_t buffer[1024];
+    struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+    const struct spa_pod *params[1];
+    struct spa_dict_item items[2];
+    float zero = 0.0f;
+
+    if ((str = intf_prop(intf, PROP_OBJECT_SERIAL)) == NULL &&
+        (str = intf_prop(intf, PROP_NODE_NAME)) == NULL)
+        return -EINVAL;
+    if ((stream = meter_stream(meter)) == NULL)
+        return -errno;
+
+    items[0] = SPA_DICT_ITEM_INIT(PW_KEY_TARGET_OBJECT, str);
+    items[1] = SPA_DICT_ITEM_INIT(PW_KEY_STREAM_CAPTURE_SINK,
+        intf->node.flags & NODE_FLAG_SINK ? "true" : "false");
+    pw_stream_update_properties(stream, &SPA_DICT_INIT(items, 2));
+
+    params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat,
+        &SPA_AUDIO_INFO_RAW_INIT(
+            .format = SPA_AUDIO_FORMAT_F32,
+            .rate = METER_RATE,
+            .channels = 1));
+
+    __atomic_store(&meter->peak, &zero, __ATOMIC_RELAXED);
+    __atomic_store(&meter->rms, &zero, __ATOMIC_RELAXED);
+
+    if (pw_stream_connect(stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+        PW_STREAM_FLAG_AUTOCONNECT |
+        PW_STREAM_FLAG_MAP_BUFFERS |
+        PW_STREAM_FLAG_RT_PROCESS |
+        PW_STREAM_FLAG_DONT_RECONNECT,
+        params, 1) < 0)
+        return -EIO;
+
+    log_debug("meter for node#%d target:%s", intf->id, str);
+    meter->intf = intf;
+    intf->node.meter = meter;
+    schedule_publish(meter->ctl);
+    return 0;
+}
+
+static void release_meter(struct meter *meter)
+{
+    if (meter->intf == NULL)
+        return;
+    log_debug("meter for node#%d released", meter->intf->id);
+    meter->intf->node.meter = NULL;
+    meter->intf = NULL;
+    pw_stream_disconnect(meter->stream);
+    schedule_publish(meter->ctl);
+}
+
+static void stop_meter(struct intf *intf)
+{
+    if (intf->node.meter != NULL)
+        release_meter(intf->node.meter);
+}
+
+/* hand the pool to the nodes that were drawn in the last frame, slots
+ * of nodes that scrolled away are recycled first; must be called with
+ * the thread loop locked */
+static void bind_meters(struct ctl *ctl)
+{
+    struct meter *meter;
+    struct intf *intf;
+    uint32_t i, free_slot = 0;
+
+    if (ctl->core == NULL)
+        return;
+
+    for (i = 0; i < ctl->n_meter_pool; i++)
+        ctl->meter_pool[i].used = false;
+    for (i = 0; i < ctl->n_visible; i++) {
+        intf = find_node(ctl, ctl->visible[i], NULL, PW_TYPE_INTERFACE_Node);
+        if (intf != NULL && intf->node.meter != NULL)
+            intf->node.meter->used = true;
+    }
+    for (i = 0; i < ctl->n_meter_pool; i++) {
+        if (!ctl->meter_pool[i].used)
+            release_meter(&ctl->meter_pool[i]);
+    }
+
+    for (i = 0; i < ctl->n_visible; i++) {
+        intf = find_node(ctl, ctl->visible[i], NULL, PW_TYPE_INTERFACE_Node);
+        if (intf == NULL || intf->node.meter != NULL || !meter_wanted(intf))
+            continue;
+
+        for (; free_slot < ctl->n_meter_pool; free_slot++)
+            if (ctl->meter_pool[free_slot].intf == NULL)
+                break;
+        if (free_slot == ctl->n_meter_pool)
+            break;
+
+        meter = &ctl->meter_pool[free_slot];
+        if (attach_meter(meter, intf) < 0)
+            free_slot++;
+    }
+}
+
+static void destroy_meters(struct ctl *ctl)
+{
+    for (uint32_t i = 0; i < ctl->n_meter_pool; i++) {
+        release_meter(&ctl->meter_pool[i]);
+        if (ctl->meter_pool[i].stream)
+            pw_stream_destroy(ctl->meter_pool[i].stream);
+        ctl->meter_pool[i].stream = NULL;
+    }
+}
+
+static void toggle_meters(struct ctl *ctl)
+{
+    lock_loop(ctl);
+    ctl->meters = !ctl->meters;
+    if (!ctl->meters) {
+        for (uint32_t i = 0; i < ctl->n_meter_pool; i++)
+            release_meter(&ctl->meter_pool[i]);
+    }
+    unlock_loop(ctl);
+
+    /* forget what is on screen so the next frame binds the pool */
+    ctl->n_visible = 0;
+}
+
+static void ctl_pipewire_free(struct ctl *ctl)
+{
+    if (ctl == NULL)
+        return;
+
+    if (ctl->mainloop)
+        pw_thread_loop_stop(ctl->mainloop);
+    if (ctl->lock_profile && ctl->loop)
+        spa_hook_remove(&ctl->loop_hook);
+    close_daemon(ctl);
+    if (ctl->registry)
+        pw_proxy_destroy((struct pw_proxy*)ctl->registry);
+    destroy_meters(ctl);
+    if (ctl->context)
+        pw_context_destroy(ctl->context);
+    if (ctl->fade_timer)
+        pw_loop_destroy_source(ctl->loop, ctl->fade_timer);
+    if (ctl->replay_timer)
+        pw_loop_destroy_source(ctl->loop, ctl->replay_timer);
+    if (ctl->publish_timer)
+        pw_loop_destroy_source(ctl->loop, ctl->publish_timer);
+    ctl->publish_timer = NULL;
+    if (ctl->events_source)
+        pw_loop_destroy_source(ctl->loop, ctl->events_source);
+    ctl->events_source = NULL;
+    /* the last figures once nothing else can change them */
+    if (ctl->metrics_timer) {
+        pw_loop_destroy_source(ctl->loop, ctl->metrics_timer);
+        write_metrics(ctl);
+    }
+    ctl->metrics_timer = NULL;
+    if (ctl->fd >= 0)
+        spa_system_close(ctl->system, ctl->fd);
+    if (ctl->signal_fd >= 0)
+        close(ctl->signal_fd);
+    if (ctl->mainloop)
+        pw_thread_loop_destroy(ctl->mainloop);
+}
+
+/** curses */
+
+static void init_bars(void);
+
+int ctl_screen_open(struct ctl *ctl, FILE *out, FILE *in)
+{
+    setlocale(LC_ALL, "");
+
+    ctl->screen = newterm(NULL, out, in);  // Start curses mode
+    if (ctl->screen == NULL)
+        return -errno;
+    if (ctl->metrics_path != NULL) {
+        int tid = syscall(SYS_gettid);
+        if (read_wchar(tid, &ctl->screen_wchar) == 0)
+            __atomic_store_n(&ctl->screen_tid, tid, __ATOMIC_RELEASE);
+    }
+    cbreak();               // Line buffering disabled
+    noecho();               // Do not echo while typing
+    keypad(stdscr, true);   // Enable special keys
+    curs_set(0);            // Hide cursor
+
+    if (has_colors()) {
+        start_color();
+
+        init_pair(1, COLOR_RED,     COLOR_BLACK);
+        init_pair(2, COLOR_GREEN,   COLOR_BLACK);
+        init_pair(3, COLOR_YELLOW,  COLOR_BLACK);
+        init_pair(4, COLOR_BLUE,    COLOR_BLACK);
+        init_pair(5, COLOR_CYAN,    COLOR_BLACK);
+        init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
+        init_pair(7, COLOR_WHITE,   COLOR_BLACK);
+    }
+
+    init_bars();
+    return 0;
+}
+
+void ctl_screen_close(struct ctl *ctl)
+{
+    if (ctl->screen == NULL)
+        return;
+    endwin();
+    delscreen(ctl->screen);
+    ctl->screen = NULL;
+}
+
+static char bar_fill[BAR_MAX + 1];
+static char bar_empty[BAR_FULL + 1];
+
+static void init_bars(void)
+{
+    memset(bar_fill, '|', BAR_MAX);
+    memset(bar_empty, '-', BAR_FULL);
+}
+
+static void invalidate_rows(struct ctl *ctl)
+{
+    for (int i = 0; i < ctl->n_row_cache; i++)
+        ctl->row_cache[i].flags = ROW_UNSET;
+    ctl->header_flags = 0;
+}
+
+static struct row_cache *get_row_cache(struct ctl *ctl, int row)
+{
+    struct row_cache *cache;
+    int i, n = LINES;
+
+    if (n != ctl->n_row_cache) {
+        if ((cache = realloc(ctl->row_cache, n * sizeof(*cache))) == NULL)
+            return NULL;
+        for (i = ctl->n_row_cache; i < n; i++)
+            cache[i].flags = ROW_UNSET;
+        ctl->row_cache = cache;
+        ctl->n_row_cache = n;
+        ctl->n_rows_drawn = SPA_MIN(ctl->n_rows_drawn, n);
+    }
+    if (row < 0 || row >= n)
+        return NULL;
+    return &ctl->row_cache[row];
+}
+
+static void format_row(struct ctl *ctl, const struct snapshot *snap,
+    const struct snap_row *row, struct row_cache *r)
+{
+    r->id = row->id;
+    r->volume = row->volume;
+    r->flags |= row->flags & (ROW_DEFAULT | ROW_MUTE);
+
+    r->rms = r->peak = 0;
+    if (row->meter != NULL) {
+        float level;
+
+        __atomic_load(&row->meter->rms, &level, __ATOMIC_RELAXED);
+        r->rms = bound_int((int)curve_from_linear(ctl->curve, level) *
+            BAR_FULL / VOLUME_FULL, 0, BAR_MAX);
+        __atomic_load(&row->meter->peak, &level, __ATOMIC_RELAXED);
+        r->peak = bound_int((int)curve_from_linear(ctl->curve, level) *
+            BAR_FULL / VOLUME_FULL, 0, BAR_MAX);
+    }
+
+    snprintf(r->name, sizeof(r->name), "%s", snap->names + row->name);
+}
+
+static bool row_changed(const struct row_cache *a, const struct row_cache *b)
+{
+    return a->id != b->id || a->flags != b->flags ||
+        a->volume != b->volume || a->rms != b->rms || a->peak != b->peak ||
+        strcmp(a->name, b->name) != 0;
+}
+
+static void draw_row(struct ctl *ctl, const struct snapshot *snap,
+    const struct snap_row *s, int row, int is_active)
+{
+    struct row_cache r, *cache;
+    char vol[16];
+    int n;
+
+    if ((cache = get_row_cache(ctl, row)) == NULL)
+        return;
+
+    r.flags = (s->flags & (ROW_PARENT | ROW_END)) |
+        (is_active ? ROW_ACTIVE : 0);
+    format_row(ctl, snap, s, &r);
+
+    if (!row_changed(&r, cache))
+        return;
+    *cache = r;
+
+    move(row, 0);
+    clrtoeol();
+
+    if (r.flags & ROW_ACTIVE)
+        attron(A_BOLD);
+
+    if (r.flags & ROW_DEFAULT)
+        mvaddnstr(row, 1, "*", 1);
+
+    move(row, 2);
+    if (!(r.flags & ROW_PARENT))
+        addstr(r.flags & ROW_END ? "└─" : "|─");
+    addstr(r.name);
+
+    n = snprintf(vol, sizeof(vol), "%d", r.volume);
+    mvaddnstr(row, 60, vol, n);
+
+    if (r.flags & ROW_MUTE) {
+        attron(COLOR_PAIR(3));
+        mvaddnstr(row, 64, "M", 1);
+        attroff(COLOR_PAIR(3));
+    }
+
+    n = bound_int(r.volume, 0, BAR_MAX);
+    move(row, BAR_COLUMN);
+    if (!(r.flags & ROW_MUTE))
+        attron(COLOR_PAIR(2));
+    addnstr(bar_fill, n);
+    if (!(r.flags & ROW_MUTE))
+        attroff(COLOR_PAIR(2));
+    if (n < BAR_FULL)
+        addnstr(bar_empty, BAR_FULL - n);
+
+    /* the meter highlights the bar in place: rms as a block, peak as a tick */
+    if (r.rms > 0)
+        mvchgat(row, BAR_COLUMN, r.rms, A_REVERSE, 5, NULL);
+    if (r.peak > r.rms)
+        mvchgat(row, BAR_COLUMN + r.peak - 1, 1, A_REVERSE, 5, NULL);
+
+    if (r.flags & ROW_ACTIVE)
+        attroff(A_BOLD);
+}
+
+static void draw_blank(struct ctl *ctl, int row)
+{
+    struct row_cache *cache;
+
+    if ((cache = get_row_cache(ctl, row)) == NULL ||
+        cache->flags == ROW_BLANK)
+        return;
+    cache->flags = ROW_BLANK;
+
+    move(row, 0);
+    clrtoeol();
+}
+
+static void draw_header(struct ctl *ctl)
+{
+    if (ctl->header_flags == ctl->node_flags)
+        return;
+    ctl->header_flags = ctl->node_flags;
+
+    move(0, 1);
+    if (ctl->node_flags & NODE_FLAG_SINK)
+        attron(A_BOLD);
+    else
+        attroff(A_BOLD);
+    printw("F1 Output");
+    attroff(A_BOLD);
+
+    printw("  ");
+    if (ctl->node_flags & NODE_FLAG_SOURCE)
+        attron(A_BOLD);
+    else
+        attroff(A_BOLD);
+    printw("F2 Input");
+    attroff(A_BOLD);
+    clrtoeol();
+}
+
+static void format_latency(char *buf, size_t size, const struct histogram *hist)
+{
+    snprintf(buf, size, "%.1f/%.1f/%.1f",
+        histogram_percentile(hist, 0.5) / 1e6,
+        histogram_percentile(hist, 0.99) / 1e6,
+        __atomic_load_n(&hist->max, __ATOMIC_RELAXED) / 1e6);
+}
+
+/* latencies on the row under the header, toggled with d */
+static void draw_overlay(struct ctl *ctl)
+{
+    struct row_cache *cache;
+    char key[64], param[64], draw[64];
+
+    if ((cache = get_row_cache(ctl, LIST_ROW - 1)) != NULL)
+        cache->flags = ROW_UNSET;
+
+    format_latency(key, sizeof(key), &ctl->key_latency);
+    format_latency(param, sizeof(param), &ctl->param_latency);
+    format_latency(draw, sizeof(draw), &ctl->draw_latency);
+    mvprintw(LIST_ROW - 1, 1, "p50/p99/max ms  key %s  server %s  ui %s",
+        key, param, draw);
+    clrtoeol();
+}
+
+/* keep the cursor on screen with as little scrolling as possible */
+static void update_viewport(struct ctl *ctl, const struct snapshot *snap,
+    int height)
+{
+    int line;
+
+    if (snap->n_rows == 0)
+        ctl->cursor = 0;
+    else if (ctl->cursor >= snap->n_rows)
+        ctl->cursor = snap->n_rows - 1;
+
+    line = snap->n_rows ? snap->rows[ctl->cursor].line : 0;
+    if (line < ctl->scroll)
+        ctl->scroll = line;
+    else if (line >= ctl->scroll + height)
+        ctl->scroll = line - height + 1;
+
+    ctl->scroll = bound_int(ctl->scroll, 0, SPA_MAX(snap->n_lines - height, 0));
+}
+
+/* index of the first row at or below line */
+static uint32_t find_row(const struct snapshot *snap, int line)
+{
+    uint32_t lo = 0, hi = snap->n_rows, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (snap->rows[mid].line < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* draws from the snapshot alone, the model is only locked to rebind
+ * the meters when the nodes on screen changed */
+static void redraw(struct ctl *ctl)
+{
+    struct snapshot *snap;
+    struct snap_row *r;
+    int height = LINES - LIST_ROW, row = LIST_ROW, line;
+    uint32_t i, n = 0;
+    bool changed;
+
+    metrics_add(&ctl->metrics, METRIC_REDRAWS, 1);
+    changed = acquire_snapshot(ctl);
+    snap = ui_snapshot(ctl);
+    update_viewport(ctl, snap, height);
+
+    draw_header(ctl);
+    if (ctl->overlay)
+        draw_overlay(ctl);
+    else
+        draw_blank(ctl, LIST_ROW - 1);
+
+    if (height > 0 && ctl->max_visible < (uint32_t)height) {
+        uint32_t *visible = realloc(ctl->visible, height * sizeof(uint32_t));
+        if (visible != NULL) {
+            ctl->visible = visible;
+            ctl->max_visible = height;
+        }
+    }
+
+    i = find_row(snap, ctl->scroll);
+    for (line = ctl->scroll; line < snap->n_lines && row < LINES; line++, row++) {
+        if (i < snap->n_rows && snap->rows[i].line == line) {
+            r = &snap->rows[i];
+            draw_row(ctl, snap, r, row, i == ctl->cursor);
+            if (n < ctl->max_visible) {
+                if (n >= ctl->n_visible || ctl->visible[n] != r->id)
+                    changed = true;
+                ctl->visible[n++] = r->id;
+            }
+            i++;
+        } else {
+            draw_blank(ctl, row);
+        }
+    }
+    if (n != ctl->n_visible)
+        changed = true;
+    ctl->n_visible = n;
+
+    /* wipe whatever is left below from the previous frame */
+    for (i = row; i < ctl->n_rows_drawn; i++)
+        draw_blank(ctl, i);
+    ctl->n_rows_drawn = row;
+
+    refresh();
+
+    if (ctl->meters && changed) {
+        lock_loop(ctl);
+        bind_meters(ctl);
+        unlock_loop(ctl);
+    }
+}
+
+/* without a loop to run the publish timer the model is published right
+ * before drawing */
+void ctl_screen_render(struct ctl *ctl)
+{
+    if (ctl->publish_timer == NULL && ctl->publish_pending)
+        publish_snapshot(ctl);
+    redraw(ctl);
+}
+
+static void toggle_curnode_mute(struct ctl *ctl)
+{
+    struct intf *intf;
+    int mute;
+
+    lock_loop(ctl);
+    if ((intf = find_curnode(ctl)) != NULL) {
+        if (intf->node.pending.has_mute)
+            mute = !intf->node.pending.mute;
+        else
+            mute = !intf->node.mute;
+
+        if (!mute && ctl->fade_in > 0) {
+            /* come back from silence instead of jumping to the level */
+            struct volume level = *queued_volume(intf), zero = level;
+
+            for (uint32_t i = 0; i < zero.n_channels; i++)
+                zero.values[i] = VOLUME_ZERO;
+            queue_volume_mute(intf, &zero, &mute);
+            start_fade(intf, &level, ctl->fade_in);
+        } else {
+            queue_volume_mute(intf, NULL, &mute);
+        }
+    }
+    unlock_loop(ctl);
+}
+
+static void fade_curnode(struct ctl *ctl)
+{
+    struct intf *intf;
+
+    lock_loop(ctl);
+    if ((intf = find_curnode(ctl)) != NULL)
+        toggle_fade(intf);
+    unlock_loop(ctl);
+}
+
+/* fade the parent and all children of the group under the cursor */
+static void fade_curgroup(struct ctl *ctl)
+{
+    struct snapshot *snap = ui_snapshot(ctl);
+    struct intf *intf;
+    uint32_t i;
+
+    lock_loop(ctl);
+    if (find_curnode(ctl) != NULL) {
+        for (i = ctl->cursor; i > 0 && !(snap->rows[i].flags & ROW_PARENT); i--);
+        do {
+            intf = find_node(ctl, snap->rows[i].id, NULL, PW_TYPE_INTERFACE_Node);
+            if (intf != NULL)
+                toggle_fade(intf);
+        } while (++i < snap->n_rows && !(snap->rows[i].flags & ROW_PARENT));
+    }
+    unlock_loop(ctl);
+}
+
+static void set_curnode_volume(struct ctl *ctl, int volume, bool relative)
+{
+    struct intf *intf;
+    struct volume *cur, vol;
+
+    lock_loop(ctl);
+    if ((intf = find_curnode(ctl)) == NULL) {
+        unlock_loop(ctl);
+        return;
+    }
+
+    /* step from the queued value so repeats add up before the ack */
+    cur = queued_volume(intf);
+
+    vol.n_channels = cur->n_channels;
+    for (uint32_t i = 0; i < vol.n_channels; i++) {
+        if (relative)
+            vol.values[i] = bound_int(volume + cur->values[i],
+                VOLUME_ZERO, VOLUME_MAX);
+        else
+            vol.values[i] = bound_int(volume, VOLUME_ZERO, VOLUME_MAX);
+    }
+
+    cancel_fade(intf);
+    intf->node.fade_level.n_channels = 0;
+    queue_volume_mute(intf, &vol, NULL);
+    unlock_loop(ctl);
+}
+
+static void set_view(struct ctl *ctl, enum node_flag flags)
+{
+    lock_loop(ctl);
+    ctl->node_flags = flags;
+    ctl->layout_dirty = true;
+    schedule_publish(ctl);
+    unlock_loop(ctl);
+}
+
+/* repaint if something changed and the frame budget allows it */
+static void flush_redraw(struct ctl *ctl)
+{
+    uint64_t count, now, param_time;
+
+    if (!__atomic_load_n(&ctl->dirty, __ATOMIC_ACQUIRE) || frame_timeout(ctl) > 0)
+        return;
+
+    spa_system_eventfd_read(ctl->system, ctl->fd, &count);
+    __atomic_store_n(&ctl->dirty, 0, __ATOMIC_RELEASE);
+    ctl->last_frame = get_time_ns();
+
+    redraw(ctl);
+
+    now = get_time_ns();
+    if (ctl->key_time) {
+        histogram_record(&ctl->key_latency, now - ctl->key_time);
+        log_debug("key-to-screen latency %" PRIu64 "us",
+            (uint64_t)((now - ctl->key_time) / SPA_NSEC_PER_USEC));
+        ctl->key_time = 0;
+    }
+    if ((param_time = __atomic_exchange_n(&ctl->param_time, 0, __ATOMIC_ACQUIRE)) != 0)
+        histogram_record(&ctl->draw_latency, now - param_time);
+}
+
+#define LATENCY_FORMAT "%s latency: %" PRIu64 " samples, p50 %" PRIu64 \
+    "us p99 %" PRIu64 "us max %" PRIu64 "us"
+
+static void log_histogram(FILE *out, const char *name, const struct histogram *hist)
+{
+    uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    uint64_t p50 = histogram_percentile(hist, 0.5) / SPA_NSEC_PER_USEC;
+    uint64_t p99 = histogram_percentile(hist, 0.99) / SPA_NSEC_PER_USEC;
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED) / SPA_NSEC_PER_USEC;
+
+    log_info(LATENCY_FORMAT, name, count, p50, p99, max);
+    if (out != NULL)
+        fprintf(out, LATENCY_FORMAT "\n", name, count, p50, p99, max);
+}
+
+/* written to the log on exit and on SIGUSR1, then also to out since the
+ * log is off unless a file was given */
+static void log_latency(struct ctl *ctl, FILE *out)
+{
+    struct lock_site *site;
+
+    log_histogram(out, "set_param to Props", &ctl->param_latency);
+    log_histogram(out, "Props to screen", &ctl->draw_latency);
+    log_histogram(out, "key to screen", &ctl->key_latency);
+
+    if (ctl->lock_profile) {
+        for (site = __atomic_load_n(&ctl->lock_sites, __ATOMIC_ACQUIRE); site;
+            site = site->next)
+        {
+            log_info("%s:", site->name);
+            if (out != NULL)
+                fprintf(out, "%s:\n", site->name);
+            log_histogram(out, "  lock wait", &site->wait);
+            log_histogram(out, "  lock hold", &site->hold);
+        }
+    }
+    if (out != NULL)
+        fflush(out);
+}
+
+static void handle_resize(struct ctl *ctl)
+{
+    struct winsize ws;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+        resizeterm(ws.ws_row, ws.ws_col);
+    clear();
+    invalidate_rows(ctl);
+    metrics_add(&ctl->metrics, METRIC_REDRAWS_REQUESTED, 1);
+    __atomic_store_n(&ctl->dirty, 1, __ATOMIC_RELEASE);
+}
+
+static void handle_signal(struct ctl *ctl)
+{
+    struct signalfd_siginfo info;
+
+    while (read(ctl->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+        case SIGWINCH:
+            handle_resize(ctl);
+            break;
+        case SIGUSR1:
+            log_latency(ctl, stderr);
+            /* the lines went over the interface when stderr is the
+             * terminal, paint all of it again */
+            if (isatty(STDERR_FILENO)) {
+                clear();
+                invalidate_rows(ctl);
+                __atomic_store_n(&ctl->dirty, 1, __ATOMIC_RELEASE);
+            }
+            break;
+        }
+    }
+}
+
+/* returns false when the user asked to quit */
+static bool handle_key(struct ctl *ctl, int ch)
+{
+    uint32_t n_rows = ui_snapshot(ctl)->n_rows;
+
+    switch (ch) {
+    case 'j':
+    case KEY_DOWN:
+        if (n_rows > 0)
+            ctl->cursor = (ctl->cursor + 1) % n_rows;
+        break;
+    case 'k':
+    case KEY_UP:
+        if (n_rows > 0)
+            ctl->cursor = (ctl->cursor - 1 + n_rows) % n_rows;
+        break;
+    case KEY_NPAGE:
+        ctl->cursor += SPA_MAX(LINES - LIST_ROW, 1);
+        break;
+    case KEY_PPAGE:
+        ctl->cursor -= SPA_MIN((uint32_t)SPA_MAX(LINES - LIST_ROW, 1), ctl->cursor);
+        break;
+    case KEY_HOME:
+        ctl->cursor = 0;
+        break;
+    case KEY_END:
+        ctl->cursor = n_rows > 0 ? n_rows - 1 : 0;
+        break;
+    case 'h':
+    case KEY_LEFT:
+        set_curnode_volume(ctl, -((int)VOLUME_FULL / 100), true);
+        break;
+    case 'l':
+    case KEY_RIGHT:
+        set_curnode_volume(ctl, VOLUME_FULL / 100, true);
+        break;
+    case 'H':
+        set_curnode_volume(ctl, -((int)VOLUME_FULL / 10), true);
+        break;
+    case 'L':
+        set_curnode_volume(ctl, VOLUME_FULL / 10, true);
+        break;
+    case 'm':
+        toggle_curnode_mute(ctl);
+        break;
+    case 'f':
+        fade_curnode(ctl);
+        break;
+    case 'F':
+        fade_curgroup(ctl);
+        break;
+    case 'v':
+        toggle_meters(ctl);
+        break;
+    case 'd':
+        ctl->overlay = !ctl->overlay;
+        break;
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+    {
+        uint32_t i = (ch - '0' + 9) % 10 + 1;
+        set_curnode_volume(ctl, VOLUME_FULL / 10 * i, false);
+        break;
+    }
+    case KEY_F(1):
+        set_view(ctl, NODE_FLAG_SINK);
+        break;
+    case KEY_F(2):
+        set_view(ctl, NODE_FLAG_SOURCE);
+        break;
+    case 'q':
+        return false;
+    }
+
+    metrics_add(&ctl->metrics, METRIC_REDRAWS_REQUESTED, 1);
+    __atomic_store_n(&ctl->dirty, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* everything curses happens here: keys from stdin, repaint requests
+ * from the pipewire thread through the eventfd and SIGWINCH through a
+ * signalfd, multiplexed with poll() */
+static void run_curses(struct ctl *ctl)
+{
+    struct pollfd fds[3];
+    int ch, timeout;
+    uint64_t count;
+    bool dirty;
+
+    nodelay(stdscr, true);
+
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].events = POLLIN;
+    fds[2].fd = ctl->signal_fd;
+    fds[2].events = POLLIN;
+
+    while (true) {
+        /* while a frame is pending the eventfd stays readable, wait for
+         * the frame deadline instead of spinning on it */
+        dirty = __atomic_load_n(&ctl->dirty, __ATOMIC_ACQUIRE);
+        timeout = dirty ? frame_timeout(ctl) : -1;
+        fds[1].fd = dirty ? -1 : ctl->fd;
+
+        if (poll(fds, SPA_N_ELEMENTS(fds), timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            log_error("poll failed: %s", strerror(errno));
+            break;
+        }
+
+        /* a write racing the last repaint can leave the eventfd readable
+         * with nothing dirty, drain it or poll keeps returning at once */
+        if (fds[1].revents & POLLIN)
+            spa_system_eventfd_read(ctl->system, ctl->fd, &count);
+
+        if (fds[2].revents & POLLIN)
+            handle_signal(ctl);
+
+        if (fds[0].revents & POLLIN) {
+            if (ctl->key_time == 0)
+                ctl->key_time = get_time_ns();
+            while ((ch = getch()) != ERR) {
+                if (ch == KEY_RESIZE)
+                    handle_resize(ctl);
+                else if (!handle_key(ctl, ch))
+                    return;
+            }
+        }
+
+        flush_redraw(ctl);
+    }
+}
+
+/** record */
+
+static bool record_begin(struct ctl *ctl, uint32_t type)
+{
+    if (ctl->journal == NULL)
+        return false;
+    journal_begin(ctl->journal, type, get_time_ns() - ctl->journal_start);
+    return true;
+}
+
+static void record_dict(struct journal *journal, const struct spa_dict *dict)
+{
+    const struct spa_dict_item *item;
+
+    journal_put_u32(journal, dict ? dict->n_items : 0);
+    if (dict == NULL)
+        return;
+    spa_dict_for_each(item, dict) {
+        journal_put_str(journal, item->key);
+        journal_put_str(journal, item->value);
+    }
+}
+
+static void record_global(struct ctl *ctl, uint32_t id,
+    uint32_t permissions, const char *type,
+    uint32_t version, const struct spa_dict *props)
+{
+    if (!record_begin(ctl, JOURNAL_GLOBAL))
+        return;
+    journal_put_u32(ctl->journal, id);
+    journal_put_u32(ctl->journal, permissions);
+    journal_put_u32(ctl->journal, version);
+    journal_put_str(ctl->journal, type);
+    journal_put_u32(ctl->journal, props != NULL);
+    record_dict(ctl->journal, props);
+    journal_end(ctl->journal);
+}
+
+static void record_remove(struct ctl *ctl, uint32_t id)
+{
+    if (!record_begin(ctl, JOURNAL_GLOBAL_REMOVE))
+        return;
+    journal_put_u32(ctl->journal, id);
+    journal_end(ctl->journal);
+}
+
+/* one layout for every object type: the fields a handler looks at, the
+ * ids of a link or the direction of a port in ext, then props and
+ * params when the change mask says they changed */
+static void record_info(struct intf *intf, uint64_t change_mask,
+    const uint32_t ext[4], const struct spa_dict *props,
+    const struct spa_param_info *params, uint32_t n_params)
+{
+    struct journal *journal = intf->ctl->journal;
+    uint32_t i;
+
+    if (!record_begin(intf->ctl, JOURNAL_INFO))
+        return;
+    journal_put_u32(journal, intf->id);
+    journal_put_u64(journal, change_mask);
+    for (i = 0; i < 4; i++)
+        journal_put_u32(journal, ext[i]);
+    record_dict(journal, props);
+    journal_put_u32(journal, n_params);
+    for (i = 0; i < n_params; i++) {
+        journal_put_u32(journal, params[i].id);
+        journal_put_u32(journal, params[i].flags);
+    }
+    journal_end(journal);
+}
+
+static void record_param(struct intf *intf, uint32_t id,
+    const struct spa_pod *param)
+{
+    struct journal *journal = intf->ctl->journal;
+
+    if (param == NULL || !record_begin(intf->ctl, JOURNAL_PARAM))
+        return;
+    journal_put_u32(journal, intf->id);
+    journal_put_u32(journal, id);
+    journal_put_data(journal, param, SPA_POD_SIZE(param));
+    journal_end(journal);
+}
+
+static void record_property(struct intf *intf, uint32_t subject,
+    const char *key, const char *type, const char *value)
+{
+    struct journal *journal = intf->ctl->journal;
+
+    if (!record_begin(intf->ctl, JOURNAL_PROPERTY))
+        return;
+    journal_put_u32(journal, intf->id);
+    journal_put_u32(journal, subject);
+    journal_put_str(journal, key);
+    journal_put_str(journal, type);
+    journal_put_str(journal, value);
+    journal_end(journal);
+}
+
+/** node */
+
+/* the reported volume is what was sent, up to the rounding of the curve,
+ * or nothing is in flight and it was changed behind our back. an older
+ * report arriving while a newer volume is on its way keeps the latter */
+static bool sent_acked(struct intf *intf)
+{
+    struct volume *sent = &intf->node.pending.sent;
+    struct volume *cur = &intf->node.channel_volume;
+    struct ctl *ctl = intf->ctl;
+
+    if (ctl->pending_seq == ctl->last_seq)
+        return true;
+    if (sent->n_channels != cur->n_channels)
+        return false;
+    for (uint32_t i = 0; i < cur->n_channels; i++) {
+        if (abs((int)sent->values[i] - (int)cur->values[i]) > 1)
+            return false;
+    }
+    return true;
+}
+
+static void parse_props(struct intf *intf, const struct spa_pod *param)
+{
+    struct ctl *ctl = intf->ctl;
+    struct spa_pod_prop *prop;
+    struct spa_pod_object *obj = (struct spa_pod_object*)param;
+
+    SPA_POD_OBJECT_FOREACH(obj, prop) {
+        switch (prop->key) {
+        case SPA_PROP_volume:
+            if (spa_pod_get_float(&prop->value, &intf->node.volume) < 0)
+                continue;
+            log_debug("update node#%d volume", intf->id);
+            break;
+        case SPA_PROP_mute:
+            if (spa_pod_get_bool(&prop->value, &intf->node.mute) < 0)
+                continue;
+            log_debug("update node#%d mute", intf->id);
+            break;
+        case SPA_PROP_channelVolumes:
+        {
+            float channels[SPA_AUDIO_MAX_CHANNELS];
+            uint32_t n_channels;
+
+            n_channels = spa_pod_copy_array(&prop->value, SPA_TYPE_Float,
+                channels, SPA_AUDIO_MAX_CHANNELS);
+
+            intf->node.channel_volume.n_channels = n_channels;
+            curve_from_linear_n(ctl->curve, channels,
+                intf->node.channel_volume.values, n_channels);
+            if (sent_acked(intf))
+                intf->node.pending.has_sent = false;
+
+            log_debug("update node#%d channelVolumes", intf->id);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    diff_node(intf);
+    schedule_publish(ctl);
+}
+
+static void node_event_info(void *data, const struct pw_node_info *info)
+{
+    struct intf *intf = data;
+    const char *str;
+    uint32_t i;
+    const uint32_t ext[4] = { 0 };
+
+    metrics_add(&intf->ctl->metrics, METRIC_INFO_NODE, 1);
+
+    record_info(intf, info->change_mask, ext,
+        info->change_mask & PW_NODE_CHANGE_MASK_PROPS ? info->props : NULL,
+        info->params, info->change_mask & PW_NODE_CHANGE_MASK_PARAMS ? info->n_params : 0);
+
+    if (info->change_mask & PW_NODE_CHANGE_MASK_PROPS && info->props) {
+        if ((str = spa_dict_lookup(info->props, "card.profile.device")))
+            intf->node.profile_device_id = atoi(str);
+        else
+            intf->node.profile_device_id = SPA_ID_INVALID;
+
+        if ((str = spa_dict_lookup(info->props, PW_KEY_DEVICE_ID)))
+            intf->node.device_id = atoi(str);
+        else
+            intf->node.device_id = SPA_ID_INVALID;
+
+        if ((str = spa_dict_lookup(info->props, PW_KEY_MEDIA_CLASS))) {
+            if (spa_streq(str, "Audio/Sink"))
+                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_SINK);
+            else if (spa_streq(str, "Audio/Source"))
+                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_SOURCE);
+            else if (spa_streq(str, "Stream/Output/Audio"))
+                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_OUTPUT | NODE_FLAG_STREAM);
+            else if (spa_streq(str, "Stream/Input/Audio"))
+                SPA_FLAG_SET(intf->node.flags, NODE_FLAG_INPUT | NODE_FLAG_STREAM);
+
+            if (!intf->node.grouped &&
+                intf->node.flags & (NODE_FLAG_SINK | NODE_FLAG_SOURCE))
+            {
+                spa_list_append(&intf->ctl->groups, &intf->node.group_link);
+                intf->node.grouped = true;
+            }
+            intf->ctl->layout_dirty = true;
+        }
+
+        if ((str = spa_dict_lookup(info->props, PW_KEY_NODE_NAME)))
+            index_node_name(intf->ctl, intf,
+                intf_prop(intf, PROP_NODE_NAME), str);
+
+        intf_update_props(intf, info->props);
+        diff_node(intf);
+        schedule_publish(intf->ctl);
+
+        log_debug("node#%d: device_id:%d profile_device_id:%d", intf->id,
+            intf->node.device_id, intf->node.profile_device_id);
+    }
+    if (info->change_mask & PW_NODE_CHANGE_MASK_PARAMS) {
+        for (i = 0; i < info->n_params; i++) {
+            if (!(info->params[i].flags & SPA_PARAM_INFO_READ))
+                continue;
+
+            switch (info->params[i].id) {
+            case SPA_PARAM_Props:
+                if (intf->proxy == NULL)
+                    break;
+                pw_node_enum_params(intf->proxy,
+                    0, info->params[i].id, 0, -1, NULL);
+                intf->ctl->n_queries++;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+/* the first Props update after a set_param is taken as its answer */
+static void match_param(struct intf *intf)
+{
+    struct ctl *ctl = intf->ctl;
+    uint64_t now, unset = 0;
+
+    if (intf->set_time == 0)
+        return;
+    now = get_time_ns();
+    histogram_record(&ctl->param_latency, now - intf->set_time);
+    intf->set_time = 0;
+    __atomic_compare_exchange_n(&ctl->param_time, &unset, now, false,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static void node_event_param(void *data, int seg,
+    uint32_t id, uint32_t index, uint32_t next,
+    const struct spa_pod *param)
+{
+    struct intf *intf = data;
+
+    metrics_add(&intf->ctl->metrics, METRIC_PARAM_EVENTS, 1);
+    record_param(intf, id, param);
+
+    switch (id) {
+    case SPA_PARAM_Props:
+        match_param(intf);
+        parse_props(intf, param);
+        break;
+    default:
+        break;
+    }
+}
+
+static void free_peers(struct ctl *ctl, struct vec *peers)
+{
+    for (uint32_t i = 0; i < peers->length; i++)
+        pool_release(ctl->pool, vec_get(peers, i), sizeof(struct peer));
+    vec_clear(peers, ctl->pool);
+}
+
+static void node_event_destroy(void *data)
+{
+    struct intf *intf = data, *target;
+    struct ctl *ctl = intf->ctl;
+    uint32_t i;
+
+    log_debug("node destroy");
+
+    diff_node_removed(intf);
+    cancel_pending(intf);
+    cancel_fade(intf);
+    stop_meter(intf);
+
+    for (i = 0; i < intf->node.ports.length; i++) {
+        target = vec_get(&intf->node.ports, i);
+        target->port.node = SPA_ID_INVALID;
+        target->port.node_ref = NULL;
+    }
+    vec_clear(&intf->node.ports, ctl->pool);
+
+    for (i = 0; i < intf->node.links.length; i++) {
+        target = vec_get(&intf->node.links, i);
+        link_disconnect(target);
+        if (intf->id == target->link.output_node) {
+            target->link.output_node = SPA_ID_INVALID;
+            target->link.output_node_ref = NULL;
+        } else {
+            target->link.input_node = SPA_ID_INVALID;
+            target->link.input_node_ref = NULL;
+        }
+    }
+    vec_clear(&intf->node.links, ctl->pool);
+
+    free_peers(ctl, &intf->node.upstream);
+    free_peers(ctl, &intf->node.downstream);
+
+    if (intf->node.grouped) {
+        spa_list_remove(&intf->node.group_link);
+        intf->node.grouped = false;
+    }
+    intf->ctl->layout_dirty = true;
+}
+
+static const struct pw_node_events node_events = {
+    PW_VERSION_NODE_EVENTS,
+    .info = node_event_info,
+    .param = node_event_param,
+};
+
+static const struct intf_info node_info = {
+    .type = PW_TYPE_INTERFACE_Node,
+    .version = PW_VERSION_NODE,
+    .events = &node_events,
+    .destroy = node_event_destroy,
+    .props = 1 << PROP_NODE_NAME | 1 << PROP_MEDIA_NAME |
+        1 << PROP_NODE_VIRTUAL | 1 << PROP_OBJECT_SERIAL,
+};
+
+/** device */
+
+static void device_event_info(void *data, const struct pw_device_info *info)
 {
     struct intf *intf = data;
-    struct ctl *ctl = intf->ctl;
+    uint32_t i;
+    const uint32_t ext[4] = { 0 };
+
+    metrics_add(&intf->ctl->metrics, METRIC_INFO_DEVICE, 1);
+
+    record_info(intf, info->change_mask, ext,
+        info->change_mask & PW_DEVICE_CHANGE_MASK_PROPS ? info->props : NULL,
+        info->params, info->change_mask & PW_DEVICE_CHANGE_MASK_PARAMS ? info->n_params : 0);
+
+    if (info->change_mask & PW_DEVICE_CHANGE_MASK_PARAMS) {
+        for (i = 0; i < info->n_params; i++) {
+            if (!(info->params[i].flags & SPA_PARAM_INFO_READ))
+                continue;
+
+            switch (info->params[i].id) {
+            case SPA_PARAM_Route:
+                if (intf->proxy == NULL)
+                    break;
+                pw_device_enum_params((struct pw_device*)intf->proxy,
+                    0, info->params[i].id, 0, -1, NULL);
+                intf->ctl->n_queries++;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+static void device_event_param(void *data, int seg,
+    uint32_t id, uint32_t index, uint32_t next,
+    const struct spa_pod *param)
+{
+    struct intf *intf = data;
+
+    metrics_add(&intf->ctl->metrics, METRIC_PARAM_EVENTS, 1);
+    record_param(intf, id, param);
+
+    switch (id) {
+    case SPA_PARAM_Route:
+    {
+        uint32_t id, device_id;
+        enum spa_direction direction;
+        struct spa_pod *props = NULL;
+
+        if (spa_pod_parse_object(param,
+            SPA_TYPE_OBJECT_ParamRoute, NULL,
+            SPA_PARAM_ROUTE_index, SPA_POD_Int(&id),
+            SPA_PARAM_ROUTE_direction, SPA_POD_Id(&direction),
+            SPA_PARAM_ROUTE_device, SPA_POD_Int(&device_id),
+            SPA_PARAM_ROUTE_props, SPA_POD_OPT_Pod(&props)) < 0)
+        {
+            return;
+        }
+
+        if (direction == SPA_DIRECTION_OUTPUT)
+            intf->device.active_route_output = id;
+        else
+            intf->device.active_route_input = id;
+
+        log_debug("device#%d: active %s route id:%d device:%d", intf->id,
+            direction == SPA_DIRECTION_OUTPUT ? "output" : "input",
+            id, device_id);
+
+        if (props != NULL) {
+            match_param(intf);
+            parse_props(intf, props);
+        }
+
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static const struct pw_device_events device_events = {
+    PW_VERSION_DEVICE_EVENTS,
+    .info = device_event_info,
+    .param = device_event_param,
+};
+
+static const struct intf_info device_info = {
+    .type = PW_TYPE_INTERFACE_Device,
+    .version = PW_VERSION_DEVICE,
+    .events = &device_events,
+};
+
+/** metadata */
+
+/* value is json with the node name, NULL when the default was cleared */
+static void update_default(struct ctl *ctl, const char *which,
+    char *name, size_t size, const char *value)
+{
     struct spa_json it[2];
     char k[1024], v[1024];
 
-    if (subject == PW_ID_CORE) {
-        if (spa_streq(key, "default.audio.sink")) {
-            spa_json_init(&it[0], value, strlen(value));
-            while (spa_json_enter_object(&it[0], &it[1]) > 0) {
-                if (spa_json_get_string(&it[1], k, sizeof(k)) > 0 &&
-                    spa_json_get_string(&it[1], v, sizeof(v)) > 0 &&
-                    spa_streq(k, "name"))
-                {
-                    strncpy(ctl->default_sink, v, sizeof(v));
-                    log_debug("found default sink %s", ctl->default_sink);
-                }
-            }
-        }
-        if (spa_streq(key, "default.audio.source")) {
-            spa_json_init(&it[0], value, strlen(value));
-            while (spa_json_enter_object(&it[0], &it[1]) > 0) {
-                if (spa_json_get_string(&it[1], k, sizeof(k)) > 0 &&
-                    spa_json_get_string(&it[1], v, sizeof(v)) > 0 &&
-                    spa_streq(k, "name"))
-                {
-                    strncpy(ctl->default_source, v, sizeof(v));
-                    log_debug("found default source %s", ctl->default_source);
-                }
-            }
+    if (value == NULL) {
+        if (name[0] != '\0')
+            diff_default(ctl, which, name, NULL);
+        name[0] = '\0';
+        log_debug("default %s cleared", which);
+        return;
+    }
+
+    spa_json_init(&it[0], value, strlen(value));
+    while (spa_json_enter_object(&it[0], &it[1]) > 0) {
+        if (spa_json_get_string(&it[1], k, sizeof(k)) > 0 &&
+            spa_json_get_string(&it[1], v, sizeof(v)) > 0 &&
+            spa_streq(k, "name"))
+        {
+            diff_default(ctl, which, name, v);
+            snprintf(name, size, "%s", v);
+            log_debug("found default %s %s", which, name);
+        }
+    }
+}
+
+static int metadata_event_property(void *data, uint32_t subject,
+    const char *key, const char *type, const char *value)
+{
+    struct intf *intf = data;
+    struct ctl *ctl = intf->ctl;
+
+    record_property(intf, subject, key, type, value);
+
+    if (subject == PW_ID_CORE) {
+        if (spa_streq(key, "default.audio.sink"))
+            update_default(ctl, "sink", ctl->default_sink,
+                sizeof(ctl->default_sink), value);
+        if (spa_streq(key, "default.audio.source"))
+            update_default(ctl, "source", ctl->default_source,
+                sizeof(ctl->default_source), value);
+        schedule_publish(ctl);
+    }
+    return 0;
+}
+
+static void metadata_event_init(void *data)
+{
+    struct intf *intf = data;
+    struct ctl *ctl = intf->ctl;
+
+    ctl->metadata = (struct pw_metadata*)intf->proxy;
+}
+
+static const struct pw_metadata_events metadata_events = {
+    PW_VERSION_METADATA_EVENTS,
+    .property = metadata_event_property,
+};
+
+static const struct intf_info metadata_info = {
+    .type = PW_TYPE_INTERFACE_Metadata,
+    .version = PW_VERSION_METADATA,
+    .events = &metadata_events,
+    .init = metadata_event_init,
+};
+
+/** link */
+
+static void link_event_info(void *data, const struct pw_link_info *info)
+{
+    struct intf *intf = data, *target;
+    struct ctl *ctl = intf->ctl;
+    const uint32_t ext[4] = {
+        info->output_node_id, info->output_port_id,
+        info->input_node_id, info->input_port_id,
+    };
+
+    metrics_add(&ctl->metrics, METRIC_INFO_LINK, 1);
+
+    record_info(intf, info->change_mask, ext, NULL, NULL, 0);
+
+    if (info->change_mask & PW_LINK_CHANGE_MASK_PROPS) {
+        intf->link.output_port = info->output_port_id;
+        intf->link.output_node = info->output_node_id;
+        intf->link.input_port = info->input_port_id;
+        intf->link.input_node = info->input_node_id;
+
+        if ((target = find_node(ctl, intf->link.output_port, NULL, NULL)) &&
+            vec_find_index(&target->port.links, intf) < 0)
+        {
+            intf->link.output_port_ref = target;
+            vec_append(&target->port.links, ctl->pool, intf);
+        }
+
+        if ((target = find_node(ctl, intf->link.output_node, NULL, NULL)) &&
+            vec_find_index(&target->node.links, intf) < 0)
+        {
+            intf->link.output_node_ref = target;
+            vec_append(&target->node.links, ctl->pool, intf);
+        }
+
+        if ((target = find_node(ctl, intf->link.input_port, NULL, NULL)) &&
+            vec_find_index(&target->port.links, intf) < 0)
+        {
+            intf->link.input_port_ref = target;
+            vec_append(&target->port.links, ctl->pool, intf);
+        }
+
+        if ((target = find_node(ctl, intf->link.input_node, NULL, NULL)) &&
+            vec_find_index(&target->node.links, intf) < 0)
+        {
+            intf->link.input_node_ref = target;
+            vec_append(&target->node.links, ctl->pool, intf);
+        }
+
+        link_connect(intf);
+
+        log_debug("link#%d: out:%d in:%d", intf->id,
+            intf->link.output_port, intf->link.input_port);
+    }
+
+    schedule_publish(ctl);
+}
+
+static void link_event_destroy(void *data)
+{
+    struct intf *intf = data, *target;
+    int i;
+
+    link_disconnect(intf);
+
+    if ((target = intf->link.output_port_ref) &&
+        (i = vec_find_index(&target->port.links, intf)) >= 0)
+    {
+        vec_swap_remove(&target->port.links, i);
+    }
+
+    if ((target = intf->link.output_node_ref) &&
+        (i = vec_find_index(&target->node.links, intf)) >= 0)
+    {
+        vec_swap_remove(&target->node.links, i);
+    }
+
+    if ((target = intf->link.input_port_ref) &&
+        (i = vec_find_index(&target->port.links, intf)) >= 0)
+    {
+        vec_swap_remove(&target->port.links, i);
+    }
+
+    if ((target = intf->link.input_node_ref) &&
+        (i = vec_find_index(&target->node.links, intf)) >= 0)
+    {
+        vec_swap_remove(&target->node.links, i);
+    }
+}
+
+static const struct pw_link_events link_events = {
+    PW_VERSION_LINK_EVENTS,
+    .info = link_event_info,
+};
+
+static const struct intf_info link_info = {
+    .type = PW_TYPE_INTERFACE_Link,
+    .version = PW_VERSION_LINK,
+    .events = &link_events,
+    .destroy = link_event_destroy,
+};
+
+/** port */
+
+static void port_event_info(void *data, const struct pw_port_info *info)
+{
+    struct intf *intf = data, *target;
+    struct ctl *ctl = intf->ctl;
+    const char *str;
+    int index;
+    const uint32_t ext[4] = { info->direction };
+
+    metrics_add(&ctl->metrics, METRIC_INFO_PORT, 1);
+
+    record_info(intf, info->change_mask, ext,
+        info->change_mask & PW_PORT_CHANGE_MASK_PROPS ? info->props : NULL,
+        NULL, 0);
+
+    if (info->change_mask & PW_PORT_CHANGE_MASK_PROPS) {
+        if ((str = intf_prop(intf, PROP_NODE_ID)) != NULL) {
+            intf->port.node = atoi(str);
+            target = find_node(ctl, intf->port.node, NULL, NULL);
+
+            if (target &&
+                vec_find_index(&target->node.ports, intf) < 0)
+            {
+                intf->port.node_ref = target;
+                vec_append(&target->node.ports, ctl->pool, intf);
+            }
+        } else {
+            if ((target = intf->port.node_ref) &&
+                (index = vec_find_index(&target->node.ports, intf)) >= 0)
+            {
+                intf->port.node_ref = NULL;
+                vec_swap_remove(&target->node.ports, index);
+            }
+
+            intf->port.node = SPA_ID_INVALID;
+        }
+
+        intf->port.direction = info->direction;
+
+        log_debug("port#%d node:%d direction:%s", intf->id,
+            intf->port.node,
+            intf->port.direction == SPA_DIRECTION_OUTPUT ? "output" : "input");
+    }
+
+    schedule_publish(ctl);
+}
+
+static void port_event_destroy(void *data)
+{
+    struct intf *intf = data, *target;
+    int i;
+
+    if ((target = intf->port.node_ref) &&
+        (i = vec_find_index(&target->node.ports, intf)) >= 0)
+    {
+        vec_swap_remove(&target->node.ports, i);
+    }
+
+    for (i = 0; i < intf->port.links.length; i++) {
+        target = vec_get(&intf->port.links, i);
+        if (intf->id == target->link.output_port) {
+            target->link.output_port = SPA_ID_INVALID;
+            target->link.output_port_ref = NULL;
+        } else {
+            target->link.input_port = SPA_ID_INVALID;
+            target->link.input_port_ref = NULL;
         }
     }
-    return 0;
+    vec_clear(&intf->port.links, intf->ctl->pool);
 }
 
-static void metadata_event_init(void *data)
+const struct pw_port_events port_events = {
+    PW_VERSION_PORT_EVENTS,
+    .info = port_event_info,
+};
+
+const struct intf_info port_info = {
+    .type = PW_TYPE_INTERFACE_Port,
+    .version = PW_VERSION_PORT,
+    .events = &port_events,
+    .destroy = port_event_destroy,
+    .props = 1 << PROP_NODE_ID,
+};
+
+/** proxy */
+
+static void proxy_event_removed(void *data)
 {
     struct intf *intf = data;
+
+    record_remove(intf->ctl, intf->id);
+    pw_proxy_destroy(intf->proxy);
+}
+
+static void remove_intf(struct intf *intf)
+{
     struct ctl *ctl = intf->ctl;
 
-    ctl->metadata = (struct pw_metadata*)intf->proxy;
+    if (intf->info->destroy)
+        intf->info->destroy(intf);
+
+    spa_list_remove(&intf->ref);
+    ctl->n_refs--;
+    idmap_remove(ctl->ids, intf->id, intf);
+    if (intf->info == &node_info)
+        index_node_name(ctl, intf,
+            intf_prop(intf, PROP_NODE_NAME), NULL);
+    intf->proxy = NULL;
+    intf_clear_props(intf);
+
+    schedule_publish(ctl);
 }
 
-static const struct pw_metadata_events metadata_events = {
-    PW_VERSION_METADATA_EVENTS,
-    .property = metadata_event_property,
+static void proxy_event_destroy(void *data)
+{
+    struct intf *intf = data;
+
+    remove_intf(intf);
+}
+
+static const struct pw_proxy_events proxy_events = {
+    PW_VERSION_PROXY_EVENTS,
+    .removed = proxy_event_removed,
+    .destroy = proxy_event_destroy,
 };
 
-static const struct intf_info metadata_info = {
-    .type = PW_TYPE_INTERFACE_Metadata,
-    .version = PW_VERSION_METADATA,
-    .events = &metadata_events,
-    .init = metadata_event_init,
+/** core */
+
+/* start a round-trip and remember how many queries were out when it did */
+static void settle(struct ctl *ctl)
+{
+    ctl->settle_queries = ctl->n_queries;
+    ctl->settle_seq = pw_core_sync(ctl->core, PW_ID_CORE, 0);
+}
+
+static void core_event_done(void *data, uint32_t id, int seq)
+{
+    struct ctl *ctl = data;
+
+    if (id == PW_ID_CORE && seq == ctl->pending_seq) {
+        uint64_t rtt = get_time_ns() - ctl->sync_time;
+
+        ctl->round_trip = ctl->round_trip ?
+            (ctl->round_trip * 7 + rtt) / 8 : rtt;
+        ctl->last_seq = seq;
+        flush_pending(ctl);
+    }
+    if (id == PW_ID_CORE && seq == ctl->settle_seq) {
+        if (ctl->n_queries != ctl->settle_queries)
+            settle(ctl);
+        else
+            ctl->settled = true;
+    }
+    if (ctl->batch)
+        pw_thread_loop_signal(ctl->mainloop, false);
+}
+
+static void core_event_error(void *data, uint32_t id, int seq,
+    int res, const char *message)
+{
+    struct ctl *ctl = data;
+
+    log_error("error id:%u seq:%d res:%d (%s): %s", id, seq, res,
+        spa_strerror(res), message);
+
+    if (id == PW_ID_CORE)
+        ctl->error = res;
+    if (ctl->batch)
+        pw_thread_loop_signal(ctl->mainloop, false);
+}
+
+static const struct pw_core_events core_events = {
+    PW_VERSION_CORE_EVENTS,
+    .done = core_event_done,
+    .error = core_event_error,
 };
 
-/** link */
+/** registry */
 
-static void link_event_info(void *data, const struct pw_link_info *info)
+static void add_proxy_listeners(struct intf *intf)
+{
+    pw_proxy_add_listener(intf->proxy,
+        &intf->proxy_listener,
+        &proxy_events, intf);
+
+    if (intf->info->events != NULL) {
+        pw_proxy_add_object_listener(intf->proxy,
+            &intf->object_listener,
+            intf->info->events, intf);
+    }
+}
+
+static const char *dict_lookup(void *data, const char *key)
+{
+    return spa_dict_lookup(data, key);
+}
+
+static uint32_t dict_get_id(const struct spa_dict *props, const char *key)
+{
+    const char *str = spa_dict_lookup(props, key);
+
+    return str ? (uint32_t)atoi(str) : SPA_ID_INVALID;
+}
+
+/* the registry globals of ports and links already carry the ids the
+ * grouping needs, take them from there instead of the info events */
+static void resolve_global(struct intf *intf, const struct spa_dict *props)
 {
-    struct intf *intf = data, *target;
     struct ctl *ctl = intf->ctl;
+    struct intf *target;
+    const char *str;
 
-    if (info->change_mask & PW_LINK_CHANGE_MASK_PROPS) {
-        intf->link.output_port = info->output_port_id;
-        intf->link.output_node = info->output_node_id;
-        intf->link.input_port = info->input_port_id;
-        intf->link.input_node = info->input_node_id;
+    if (props == NULL)
+        return;
 
-        if ((target = find_node(ctl, intf->link.output_port, NULL, NULL)) &&
-            array_find_index(target->port.links, intf) < 0)
-        {
-            intf->link.output_port_ref = target;
-            array_append(target->port.links, intf);
-        }
+    if (intf->info == &link_info) {
+        struct pw_link_info info = {
+            .id = intf->id,
+            .output_node_id = dict_get_id(props, PW_KEY_LINK_OUTPUT_NODE),
+            .output_port_id = dict_get_id(props, PW_KEY_LINK_OUTPUT_PORT),
+            .input_node_id = dict_get_id(props, PW_KEY_LINK_INPUT_NODE),
+            .input_port_id = dict_get_id(props, PW_KEY_LINK_INPUT_PORT),
+            .change_mask = PW_LINK_CHANGE_MASK_PROPS,
+        };
+        link_event_info(intf, &info);
+        return;
+    }
 
-        if ((target = find_node(ctl, intf->link.output_node, NULL, NULL)) &&
-            array_find_index(target->node.links, intf) < 0)
+    intf->port.node = dict_get_id(props, PW_KEY_NODE_ID);
+    str = spa_dict_lookup(props, PW_KEY_PORT_DIRECTION);
+    intf->port.direction = spa_streq(str, "out") ?
+        PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT;
+
+    if ((target = find_node(ctl, intf->port.node, NULL, PW_TYPE_INTERFACE_Node))) {
+        intf->port.node_ref = target;
+        vec_append(&target->node.ports, ctl->pool, intf);
+    }
+}
+
+struct intf *ctl_add_global(struct ctl *ctl, uint32_t id,
+    uint32_t permissions, const char *type,
+    uint32_t version, const struct spa_dict *props)
+{
+    struct intf *intf;
+    struct pw_proxy *proxy = NULL;
+    const struct intf_info *info = NULL;
+    const char *str;
+    bool lazy;
+
+    if (props == NULL)
+        return NULL;
+    if (spa_streq(type, PW_TYPE_INTERFACE_Node)) {
+        if ((str = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS)) == NULL)
+            return NULL;
+        /* our own level meters */
+        if (spa_streq(spa_dict_lookup(props, PW_KEY_NODE_NAME), METER_NODE_NAME))
+            return NULL;
+        if (!filter_match(ctl->filter, dict_lookup, (void*)props)) {
+            log_debug("skipped node#%d type:%s", id, str);
+            idmap_put(ctl->skipped, id, ctl);
+            return NULL;
+        }
+        log_debug("found node#%d type:%s", id, str);
+        info = &node_info;
+    } else if (spa_streq(type, PW_TYPE_INTERFACE_Device)) {
+        if ((str = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS)) == NULL)
+            return NULL;
+        log_debug("found device#%d type:%s", id, str);
+        info = &device_info;
+    } else if (spa_streq(type, PW_TYPE_INTERFACE_Metadata)) {
+        if ((str = spa_dict_lookup(props, PW_KEY_METADATA_NAME)) == NULL ||
+            !spa_streq(str, "default"))
         {
-            intf->link.output_node_ref = target;
-            array_append(target->node.links, intf);
+            return NULL;
         }
+        log_debug("found metadata#%d name:%s", id, str);
+        info = &metadata_info;
+    } else if (spa_streq(type, PW_TYPE_INTERFACE_Link)) {
+        if (idmap_get(ctl->skipped, dict_get_id(props, PW_KEY_LINK_OUTPUT_NODE)) ||
+            idmap_get(ctl->skipped, dict_get_id(props, PW_KEY_LINK_INPUT_NODE)))
+            return NULL;
+        log_debug("found link#%d", id);
+        info = &link_info;
+    } else if (spa_streq(type, PW_TYPE_INTERFACE_Port)) {
+        if (idmap_get(ctl->skipped, dict_get_id(props, PW_KEY_NODE_ID)))
+            return NULL;
+        log_debug("found port#%d", id);
+        info = &port_info;
+    } else
+        return NULL;
+
+    lazy = ctl->lazy_ports && (info == &port_info || info == &link_info);
+
+    /* without a registry the object only lives in our model */
+    if (ctl->registry != NULL && !lazy) {
+        proxy = pw_registry_bind(ctl->registry, id,
+            info->type, info->version, sizeof(struct intf));
+        if (proxy == NULL)
+            return NULL;
+        intf = pw_proxy_get_user_data(proxy);
+        ctl->n_queries++;
+        metrics_add(&ctl->metrics, METRIC_GLOBALS_BOUND, 1);
+    } else if ((intf = calloc(1, sizeof(struct intf))) == NULL) {
+        return NULL;
+    }
+    intf->ctl = ctl;
+    intf->id = id;
+    intf->perms = permissions;
+    intf->proxy = proxy;
+    intf->info = info;
+    if (props && !lazy)
+        intf_update_props(intf, props);
+    spa_list_append(&ctl->refs, &intf->ref);
+    idmap_put(ctl->ids, id, intf);
+    if (info == &node_info)
+        index_node_name(ctl, intf, NULL, intf_prop(intf, PROP_NODE_NAME));
+    ctl->n_refs++;
 
-        if ((target = find_node(ctl, intf->link.input_port, NULL, NULL)) &&
-            array_find_index(target->port.links, intf) < 0)
-        {
-            intf->link.input_port_ref = target;
-            array_append(target->port.links, intf);
+    if (proxy != NULL)
+        add_proxy_listeners(intf);
+
+    if (info->init)
+        info->init(intf);
+
+    if (lazy)
+        resolve_global(intf, props);
+
+    return intf;
+}
+
+void ctl_set_lazy_ports(struct ctl *ctl, bool lazy)
+{
+    ctl->lazy_ports = lazy;
+}
+
+size_t ctl_props_size(struct ctl *ctl, uint32_t *n_strings)
+{
+    if (n_strings)
+        *n_strings = ctl->intern->length;
+    return ctl->intern->bytes;
+}
+
+int ctl_remove_global(struct ctl *ctl, uint32_t id)
+{
+    struct intf *intf = idmap_get(ctl->ids, id);
+
+    if (intf == NULL)
+        return idmap_remove(ctl->skipped, id, ctl) < 0 ? -ENOENT : 0;
+    if (intf->proxy != NULL) {
+        pw_proxy_destroy(intf->proxy);
+    } else {
+        remove_intf(intf);
+        free(intf);
+    }
+    return 0;
+}
+
+int ctl_emit_info(struct ctl *ctl, uint32_t id, const void *info)
+{
+    struct intf *intf = idmap_get(ctl->ids, id);
+
+    if (intf == NULL)
+        return -ENOENT;
+    if (intf->info == &node_info)
+        node_event_info(intf, info);
+    else if (intf->info == &device_info)
+        device_event_info(intf, info);
+    else if (intf->info == &link_info)
+        link_event_info(intf, info);
+    else if (intf->info == &port_info)
+        port_event_info(intf, info);
+    else
+        return -ENOTSUP;
+    return 0;
+}
+
+int ctl_emit_param(struct ctl *ctl, uint32_t id, uint32_t param_id,
+    const struct spa_pod *param)
+{
+    struct intf *intf = idmap_get(ctl->ids, id);
+
+    if (intf == NULL)
+        return -ENOENT;
+    if (intf->info == &node_info)
+        node_event_param(intf, 0, param_id, 0, 0, param);
+    else if (intf->info == &device_info)
+        device_event_param(intf, 0, param_id, 0, 0, param);
+    else
+        return -ENOTSUP;
+    return 0;
+}
+
+int ctl_emit_property(struct ctl *ctl, uint32_t id, uint32_t subject,
+    const char *key, const char *type, const char *value)
+{
+    struct intf *intf = idmap_get(ctl->ids, id);
+
+    if (intf == NULL)
+        return -ENOENT;
+    if (intf->info != &metadata_info)
+        return -ENOTSUP;
+    metadata_event_property(intf, subject, key, type, value);
+    return 0;
+}
+
+static void registry_event_global(void *data, uint32_t id,
+    uint32_t permissions, const char *type,
+    uint32_t version, const struct spa_dict *props)
+{
+    record_global(data, id, permissions, type, version, props);
+    ctl_add_global(data, id, permissions, type, version, props);
+}
+
+/* objects with a proxy hear about their removal from it, the rest are
+ * kept lazily or were skipped */
+static void registry_event_global_remove(void *data, uint32_t id)
+{
+    struct ctl *ctl = data;
+    struct intf *intf = idmap_get(ctl->ids, id);
+
+    if (intf != NULL && intf->proxy != NULL)
+        return;
+    if (intf != NULL || idmap_get(ctl->skipped, id) != NULL) {
+        record_remove(ctl, id);
+        ctl_remove_global(ctl, id);
+    }
+}
+
+static const struct pw_registry_events registry_events = {
+    PW_VERSION_REGISTRY,
+    .global = registry_event_global,
+    .global_remove = registry_event_global_remove,
+};
+
+/** replay */
+
+static int replay_dict(struct journal *journal,
+    struct spa_dict_item *items, struct spa_dict *dict)
+{
+    const char *key, *value;
+    uint32_t i, n_items;
+
+    if (journal_get_u32(journal, &n_items) < 0)
+        return -EINVAL;
+    for (i = 0; i < n_items; i++) {
+        if (journal_get_str(journal, &key) < 0 ||
+            journal_get_str(journal, &value) < 0)
+            return -EINVAL;
+        if (i < REPLAY_MAX_ITEMS)
+            items[i] = SPA_DICT_ITEM_INIT(key, value);
+    }
+    *dict = SPA_DICT_INIT(items, SPA_MIN(n_items, REPLAY_MAX_ITEMS));
+    return 0;
+}
+
+static int replay_global(struct ctl *ctl, struct journal *journal)
+{
+    struct spa_dict_item items[REPLAY_MAX_ITEMS];
+    struct spa_dict props;
+    uint32_t id, permissions, version, has_props;
+    const char *type;
+
+    if (journal_get_u32(journal, &id) < 0 ||
+        journal_get_u32(journal, &permissions) < 0 ||
+        journal_get_u32(journal, &version) < 0 ||
+        journal_get_str(journal, &type) < 0 ||
+        journal_get_u32(journal, &has_props) < 0 ||
+        replay_dict(journal, items, &props) < 0)
+        return -EINVAL;
+
+    ctl_add_global(ctl, id, permissions, type, version,
+        has_props ? &props : NULL);
+    return 0;
+}
+
+static int replay_info(struct ctl *ctl, struct journal *journal)
+{
+    struct spa_dict_item items[REPLAY_MAX_ITEMS];
+    struct spa_param_info params[REPLAY_MAX_PARAMS];
+    struct spa_dict props;
+    struct intf *intf;
+    uint32_t id, ext[4], n_params, param_id, flags, i;
+    uint64_t change_mask;
+
+    if (journal_get_u32(journal, &id) < 0 ||
+        journal_get_u64(journal, &change_mask) < 0)
+        return -EINVAL;
+    for (i = 0; i < 4; i++)
+        if (journal_get_u32(journal, &ext[i]) < 0)
+            return -EINVAL;
+    if (replay_dict(journal, items, &props) < 0 ||
+        journal_get_u32(journal, &n_params) < 0)
+        return -EINVAL;
+    for (i = 0; i < n_params; i++) {
+        if (journal_get_u32(journal, &param_id) < 0 ||
+            journal_get_u32(journal, &flags) < 0)
+            return -EINVAL;
+        if (i < REPLAY_MAX_PARAMS)
+            params[i] = (struct spa_param_info) { .id = param_id, .flags = flags };
+    }
+    n_params = SPA_MIN(n_params, REPLAY_MAX_PARAMS);
+
+    /* objects the mixer skipped when they were announced */
+    if ((intf = idmap_get(ctl->ids, id)) == NULL)
+        return 0;
+
+    if (intf->info == &node_info) {
+        struct pw_node_info info = {
+            .id = id,
+            .change_mask = change_mask,
+            .props = &props,
+            .params = params,
+            .n_params = n_params,
+        };
+        return ctl_emit_info(ctl, id, &info);
+    } else if (intf->info == &device_info) {
+        struct pw_device_info info = {
+            .id = id,
+            .change_mask = change_mask,
+            .props = &props,
+            .params = params,
+            .n_params = n_params,
+        };
+        return ctl_emit_info(ctl, id, &info);
+    } else if (intf->info == &port_info) {
+        struct pw_port_info info = {
+            .id = id,
+            .direction = ext[0],
+            .change_mask = change_mask,
+            .props = &props,
+        };
+        return ctl_emit_info(ctl, id, &info);
+    } else if (intf->info == &link_info) {
+        struct pw_link_info info = {
+            .id = id,
+            .output_node_id = ext[0],
+            .output_port_id = ext[1],
+            .input_node_id = ext[2],
+            .input_port_id = ext[3],
+            .change_mask = change_mask,
+        };
+        return ctl_emit_info(ctl, id, &info);
+    }
+    return 0;
+}
+
+static int replay_param(struct ctl *ctl, struct journal *journal)
+{
+    const struct spa_pod *param;
+    const void *data;
+    uint32_t id, param_id, size;
+
+    if (journal_get_u32(journal, &id) < 0 ||
+        journal_get_u32(journal, &param_id) < 0 ||
+        journal_get_data(journal, &data, &size) < 0)
+        return -EINVAL;
+
+    param = data;
+    if (size < sizeof(struct spa_pod) || SPA_POD_SIZE(param) > size)
+        return -EINVAL;
+    ctl_emit_param(ctl, id, param_id, param);
+    return 0;
+}
+
+static int replay_property(struct ctl *ctl, struct journal *journal)
+{
+    uint32_t id, subject;
+    const char *key, *type, *value;
+
+    if (journal_get_u32(journal, &id) < 0 ||
+        journal_get_u32(journal, &subject) < 0 ||
+        journal_get_str(journal, &key) < 0 ||
+        journal_get_str(journal, &type) < 0 ||
+        journal_get_str(journal, &value) < 0)
+        return -EINVAL;
+    ctl_emit_property(ctl, id, subject, key, type, value);
+    return 0;
+}
+
+int ctl_replay(struct ctl *ctl, struct journal *journal,
+    uint64_t until, uint32_t max)
+{
+    struct journal_record record;
+    uint32_t id, n = 0;
+    int res = 0;
+
+    while (n < max && (res = journal_read(journal, &record)) > 0) {
+        if (record.time > until) {
+            journal_unread(journal);
+            break;
         }
 
-        if ((target = find_node(ctl, intf->link.input_node, NULL, NULL)) &&
-            array_find_index(target->node.links, intf) < 0)
-        {
-            intf->link.input_node_ref = target;
-            array_append(target->node.links, intf);
+        switch (record.type) {
+        case JOURNAL_GLOBAL:
+            res = replay_global(ctl, journal);
+            break;
+        case JOURNAL_GLOBAL_REMOVE:
+            if ((res = journal_get_u32(journal, &id)) == 0)
+                ctl_remove_global(ctl, id);
+            break;
+        case JOURNAL_INFO:
+            res = replay_info(ctl, journal);
+            break;
+        case JOURNAL_PARAM:
+            res = replay_param(ctl, journal);
+            break;
+        case JOURNAL_PROPERTY:
+            res = replay_property(ctl, journal);
+            break;
+        default:
+            /* newer record types are skipped */
+            break;
         }
-
-        log_debug("link#%d: out:%d in:%d", intf->id,
-            intf->link.output_port, intf->link.input_port);
+        if (res == -EINVAL)
+            return res;
+        res = 0;
+        n++;
     }
-
-    redraw(ctl);
+    return res < 0 ? res : (int)n;
 }
 
-static void link_event_destroy(void *data)
+static void arm_replay(struct ctl *ctl, uint64_t delay)
 {
-    struct intf *intf = data, *target;
-    int i;
+    /* a zero timeout would disarm the timer */
+    struct timespec value = {
+        .tv_sec = delay / SPA_NSEC_PER_SEC,
+        .tv_nsec = SPA_MAX(delay % SPA_NSEC_PER_SEC, 1u),
+    };
+    pw_loop_update_timer(ctl->loop, ctl->replay_timer, &value, NULL, false);
+}
 
-    if ((target = intf->link.output_port_ref) &&
-        (i = array_find_index(target->port.links, intf)) >= 0)
-    {
-        array_remove(target->port.links, i);
+/* feeds whatever is due on the journal clock, or a batch at a time
+ * when replaying as fast as possible, then sleeps until the next
+ * record is due */
+static void on_replay_timeout(void *data, uint64_t expirations)
+{
+    struct ctl *ctl = data;
+    struct journal_record next;
+    uint64_t until = UINT64_MAX;
+    uint32_t max = REPLAY_BATCH;
+    int res;
+
+    if (ctl->replay_speed > 0) {
+        until = (get_time_ns() - ctl->replay_start) * ctl->replay_speed;
+        max = UINT32_MAX;
     }
 
-    if ((target = intf->link.output_node_ref) &&
-        (i = array_find_index(target->node.links, intf)) >= 0)
+    if ((res = ctl_replay(ctl, ctl->replay, until, max)) < 0 ||
+        (res = journal_peek(ctl->replay, &next)) <= 0)
     {
-        array_remove(target->node.links, i);
+        if (res < 0)
+            log_error("replay failed: %s", spa_strerror(res));
+        log_info("replay finished after %" PRIu64 " records in %" PRIu64 "ms",
+            ctl->replay->n_records,
+            (uint64_t)((get_time_ns() - ctl->replay_start) / SPA_NSEC_PER_MSEC));
+        return;
     }
 
-    if ((target = intf->link.input_port_ref) &&
-        (i = array_find_index(target->port.links, intf)) >= 0)
-    {
-        array_remove(target->port.links, i);
+    if (ctl->replay_speed > 0)
+        arm_replay(ctl, (next.time - until) / ctl->replay_speed);
+    else
+        arm_replay(ctl, 0);
+}
+
+struct ctl *ctl_new(void)
+{
+    struct ctl *ctl = calloc(1, sizeof(struct ctl));
+    if (!ctl) {
+        return NULL;
     }
 
-    if ((target = intf->link.input_node_ref) &&
-        (i = array_find_index(target->node.links, intf)) >= 0)
+    ctl->ids = idmap_new();
+    ctl->names = strmap_new();
+    ctl->skipped = idmap_new();
+    ctl->intern = intern_new();
+    ctl->pool = pool_new();
+    ctl->curve = curve_new(CURVE_CUBIC, VOLUME_FULL, VOLUME_MAX);
+    if (!ctl->ids || !ctl->names || !ctl->skipped || !ctl->intern ||
+        !ctl->pool || !ctl->curve)
     {
-        array_remove(target->node.links, i);
+        idmap_free(ctl->ids);
+        strmap_free(ctl->names);
+        idmap_free(ctl->skipped);
+        intern_free(ctl->intern);
+        pool_free(ctl->pool);
+        curve_free(ctl->curve);
+        free(ctl);
+        return NULL;
     }
-}
-
-static const struct pw_link_events link_events = {
-    PW_VERSION_LINK_EVENTS,
-    .info = link_event_info,
-};
-
-static const struct intf_info link_info = {
-    .type = PW_TYPE_INTERFACE_Link,
-    .version = PW_VERSION_LINK,
-    .events = &link_events,
-    .destroy = link_event_destroy,
-};
 
-/** port */
+    ctl->fd = -1;
+    ctl->signal_fd = -1;
+    ctl->node_flags = NODE_FLAG_SINK;
+    ctl->dirty = 1;
+    ctl->frame_interval = SPA_NSEC_PER_SEC / DEFAULT_FPS;
+    ctl->layout_dirty = true;
+    ctl->snap_front = 0;
+    ctl->snap_middle = 1;
+    ctl->snap_back = 2;
+    spa_list_init(&ctl->refs);
+    spa_list_init(&ctl->groups);
+    spa_list_init(&ctl->pending);
+    spa_list_init(&ctl->fades);
+    spa_list_init(&ctl->clients);
+    return ctl;
+}
 
-static void port_event_info(void *data, const struct pw_port_info *info)
+void ctl_free(struct ctl *ctl)
 {
-    struct intf *intf = data, *target;
-    struct ctl *ctl = intf->ctl;
-    const char *str;
-    int index;
+    struct intf *intf, *tmp;
+    uint32_t i;
 
-    if (info->change_mask & PW_PORT_CHANGE_MASK_PROPS) {
-        if ((str = pw_properties_get(intf->props, PW_KEY_NODE_ID)) != NULL) {
-            intf->port.node = atoi(str);
-            target = find_node(ctl, intf->port.node, NULL, NULL);
+    if (ctl == NULL)
+        return;
 
-            if (target &&
-                array_find_index(target->node.ports, intf) < 0)
-            {
-                intf->port.node_ref = target;
-                array_append(target->node.ports, intf);
-            }
-        } else {
-            if ((target = intf->port.node_ref) &&
-                (index = array_find_index(target->node.ports, intf)) >= 0)
-            {
-                intf->port.node_ref = NULL;
-                array_remove(target->node.ports, index);
-            }
+    ctl_pipewire_free(ctl);
+    if (journal_close(ctl->journal) < 0)
+        log_error("recording is incomplete");
+    journal_close(ctl->replay);
 
-            intf->port.node = SPA_ID_INVALID;
+    /* objects fed without a server have nothing else to clean them up */
+    spa_list_for_each_safe(intf, tmp, &ctl->refs, ref) {
+        if (intf->proxy == NULL) {
+            remove_intf(intf);
+            free(intf);
         }
+    }
 
-        intf->port.direction = info->direction;
+    ctl_screen_close(ctl);
+    idmap_free(ctl->ids);
+    strmap_free(ctl->names);
+    idmap_free(ctl->skipped);
+    intern_free(ctl->intern);
+    pool_free(ctl->pool);
+    curve_free(ctl->curve);
+    filter_free(ctl->filter);
+    free(ctl->rows);
+    for (i = 0; i < SPA_N_ELEMENTS(ctl->snapshots); i++) {
+        free(ctl->snapshots[i].rows);
+        free(ctl->snapshots[i].names);
+    }
+    free(ctl->row_cache);
+    free(ctl->visible);
+    free(ctl->events);
+    free(ctl->meter_pool);
+    free(ctl);
+}
 
-        log_debug("port#%d node:%d direction:%s", intf->id,
-            intf->port.node,
-            intf->port.direction == SPA_DIRECTION_OUTPUT ? "output" : "input");
+/* the benchmarks link the model without the front-end */
+#ifndef PWMIXER_NO_MAIN
+/** batch */
+
+/* wait until the model holds the whole graph, stage every command in one
+ * lock hold and send them as a single batch; nothing is sent when one
+ * of them fails */
+static int run_script(struct ctl *ctl, struct script *script)
+{
+    struct script_command *command;
+    uint64_t start = get_time_ns(), settled;
+    int i, res = 0;
+
+    lock_loop(ctl);
+    while (!ctl->settled && ctl->error == 0)
+        wait_loop(ctl);
+    settled = get_time_ns();
+
+    for (i = 0; i < script->length && ctl->error == 0; i++) {
+        command = &script->commands[i];
+        if ((res = apply_command(ctl, command, stdout)) < 0) {
+            fprintf(stderr, "%s: %s\n", command->target ? command->target :
+                SCRIPT_DEFAULT_SINK, command_error(res));
+            break;
+        }
+    }
+    if (res == 0 && ctl->error == 0 && !spa_list_is_empty(&ctl->pending)) {
+        flush_pending(ctl);
+        while (ctl->last_seq != ctl->pending_seq && ctl->error == 0)
+            wait_loop(ctl);
+    }
+    if (ctl->error < 0) {
+        fprintf(stderr, "error: %s\n", spa_strerror(ctl->error));
+        res = ctl->error;
     }
+    unlock_loop(ctl);
 
-    redraw(ctl);
+    log_info("batch: %u queries settled in %"PRIu64" us, %d commands done in %"PRIu64" us",
+        ctl->n_queries, (uint64_t)((settled - start) / SPA_NSEC_PER_USEC),
+        i, (uint64_t)((get_time_ns() - settled) / SPA_NSEC_PER_USEC));
+    return res;
 }
 
-static void port_event_init(void *data)
+static void on_quit(void *data, int signal_number)
 {
-    struct intf *intf = data;
+    struct ctl *ctl = data;
 
-    intf->port.links = array_new(sizeof(struct intf*));
+    ctl->quit = true;
+    pw_thread_loop_signal(ctl->mainloop, false);
 }
 
-static void port_event_destroy(void *data)
+static void on_dump(void *data, int signal_number)
 {
-    struct intf *intf = data, *target;
-    int i;
+    log_latency(data, stderr);
+}
 
-    if ((target = intf->port.node_ref) &&
-        (i = array_find_index(target->node.ports, intf)) >= 0)
-    {
-        array_remove(target->node.ports, i);
+/* serve the socket, or only the --watch feed when path is NULL, until
+ * SIGINT or SIGTERM or until the server goes */
+static int run_daemon(struct ctl *ctl, const char *path)
+{
+    struct spa_source *sources[3];
+    int res = 0;
+
+    lock_loop(ctl);
+    sources[0] = pw_loop_add_signal(ctl->loop, SIGINT, on_quit, ctl);
+    sources[1] = pw_loop_add_signal(ctl->loop, SIGTERM, on_quit, ctl);
+    sources[2] = pw_loop_add_signal(ctl->loop, SIGUSR1, on_dump, ctl);
+
+    /* clients should not see the graph half built */
+    while (!ctl->settled && ctl->error == 0 && !ctl->quit)
+        wait_loop(ctl);
+    if (path != NULL && ctl->error == 0 && !ctl->quit) {
+        if ((res = open_daemon(ctl, path)) < 0)
+            fprintf(stderr, "cannot listen on %s: %s\n", path, spa_strerror(res));
+        else
+            log_info("listening on %s", path);
     }
 
-    for (i = 0; i < intf->port.links->length; i++) {
-        target = array_get(intf->port.links, i);
-        if (intf->id == target->link.output_port) {
-            target->link.output_port = SPA_ID_INVALID;
-            target->link.output_port_ref = NULL;
-        } else {
-            target->link.input_port = SPA_ID_INVALID;
-            target->link.input_port_ref = NULL;
-        }
+    while (res == 0 && ctl->error == 0 && !ctl->quit)
+        wait_loop(ctl);
+    if (ctl->error < 0) {
+        fprintf(stderr, "error: %s\n", spa_strerror(ctl->error));
+        res = ctl->error;
     }
-    array_free(intf->port.links);
-    intf->port.links = NULL;
-}
-
-const struct pw_port_events port_events = {
-    PW_VERSION_PORT_EVENTS,
-    .info = port_event_info,
-};
 
-const struct intf_info port_info = {
-    .type = PW_TYPE_INTERFACE_Port,
-    .version = PW_VERSION_PORT,
-    .events = &port_events,
-    .init = port_event_init,
-    .destroy = port_event_destroy,
-};
-
-/** proxy */
-
-static void proxy_event_removed(void *data)
-{
-    struct intf *intf = data;
-    pw_proxy_destroy(intf->proxy);
+    close_daemon(ctl);
+    for (uint32_t i = 0; i < SPA_N_ELEMENTS(sources); i++) {
+        if (sources[i] != NULL)
+            pw_loop_destroy_source(ctl->loop, sources[i]);
+    }
+    unlock_loop(ctl);
+    return res;
 }
 
-static void proxy_event_destroy(void *data)
+/* must be called with the thread loop locked */
+static int connect_server(struct ctl *ctl)
 {
-    struct intf *intf = data;
+    ctl->journal_start = get_time_ns();
+    ctl->core = pw_context_connect(ctl->context, NULL, 0);
+    if (ctl->core == NULL) {
+        log_error("pw_core create failed");
+        return -errno;
+    }
 
-    if (intf->info->destroy)
-        intf->info->destroy(intf);
+    pw_core_add_listener(ctl->core, &ctl->core_listener,
+        &core_events, ctl);
 
-    spa_list_remove(&intf->ref);
-    intf->proxy = NULL;
-    pw_properties_free(intf->props);
+    ctl->registry = pw_core_get_registry(ctl->core, PW_VERSION_REGISTRY, 0);
+    if (ctl->registry == NULL) {
+        log_error("pw_registry create failed");
+        return -errno;
+    }
+    pw_registry_add_listener(ctl->registry, &ctl->registry_listener,
+        &registry_events, ctl);
+    return 0;
 }
 
-static const struct pw_proxy_events proxy_events = {
-    PW_VERSION_PROXY_EVENTS,
-    .removed = proxy_event_removed,
-    .destroy = proxy_event_destroy,
-};
-
-/** registry */
+static void show_help(const char *name)
+{
+    fprintf(stdout, "%s [options] [command]\n"
+        "  -h, --help            Show this help\n"
+        "  -f, --fps=FPS         Redraw at most FPS times per second (default %d)\n"
+        "      --fade-in=MS      Fade in over MS milliseconds when unmuting\n"
+        "  -m, --meter           Show signal level meters\n"
+        "      --meter-pool=N    Meter at most N visible nodes at once (default %d)\n"
+        "      --log-file=PATH   Write a log to PATH\n"
+        "      --log-level=LEVEL Log error, warn, info, debug or trace (default debug)\n"
+        "      --record=FILE     Record registry events to FILE\n"
+        "      --replay=FILE     Replay recorded events from FILE instead of a server\n"
+        "      --replay-speed=X  Replay X times as fast as recorded, 0 for no delays (default 1)\n"
+        "      --lazy-ports      Group from the registry alone, do not bind ports and links\n"
+        "      --filter=EXPR     Only bind nodes matching EXPR: key=glob, key!=glob,\n"
+        "                        key~regex, key!~regex or hardware (repeatable)\n"
+        "      --filter-file=PATH Read filter expressions from PATH, one per line\n"
+        "      --daemon          Serve commands on a unix socket instead of the interface\n"
+        "      --socket=PATH     Socket for --daemon (default $XDG_RUNTIME_DIR/pwmixer.sock)\n"
+        "      --watch           Print a line per change instead of the interface\n"
+        "      --json            Write JSON, needed by --watch and used by list too\n"
+        "      --metrics=PATH    Write counters to PATH every %ds, in the Prometheus\n"
+        "                        text format\n"
+        "      --lock-profile[=MS] Time the loop lock per call site, log holds over MS\n"
+        "                        milliseconds (default %d)\n"
+        "      --curve=CURVE     Volume curve: linear, cubic (default), db, db:FLOOR\n"
+        "                        or points as POS:GAIN,... in percent\n"
+        "\n"
+        "commands, run without the interface:\n"
+        "  list [--json]                  List sinks, sources and streams\n"
+        "  set-volume [TARGET] VOLUME     Set VOLUME as N%%, or step it by +N%% or -N%%\n"
+        "  mute [TARGET] [on|off|toggle]  Mute, unmute or toggle (default toggle)\n"
+        "  unmute [TARGET]                Unmute\n"
+        "  apply FILE                     Run the commands in FILE, one per line, - for stdin\n"
+        "TARGET is a node id, a node name, " SCRIPT_DEFAULT_SINK " or " SCRIPT_DEFAULT_SOURCE
+        " (default " SCRIPT_DEFAULT_SINK ")\n",
+        name, DEFAULT_FPS, METER_POOL, METRICS_INTERVAL, LOCK_THRESHOLD);
+}
 
-static void registry_event_global(void *data, uint32_t id,
-    uint32_t permissions, const char *type,
-    uint32_t version, const struct spa_dict *props)
+int main(int argc, char *argv[])
 {
-    struct ctl *ctl = data;
-    struct intf *intf;
-    struct pw_proxy *proxy;
-    const struct intf_info *info = NULL;
-    const char *str;
+    struct ctl *ctl;
+    struct pw_loop *loop;
+    sigset_t mask;
+    int c, res, fps = DEFAULT_FPS, fade_in = 0;
+    bool meters = false;
+    int meter_pool = METER_POOL;
+    const char *log_path = NULL, *metrics_path = NULL;
+    struct timespec interval = { METRICS_INTERVAL, 0 };
+    int log_level_arg = LOG_LEVEL_DEBUG;
+    const char *record_path = NULL, *replay_path = NULL;
+    double replay_speed = 1.0;
+    bool lazy_ports = false;
+    bool lock_profile = false;
+    long lock_threshold = LOCK_THRESHOLD;
+    struct filter *filter = NULL;
+    struct curve *curve = NULL;
+    struct script *script = NULL;
+    bool daemon = false, watch = false, json = false;
+    char socket_path[108] = "";
+    int line;
+    char *end;
+    static const struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "fps", required_argument, NULL, 'f' },
+        { "fade-in", required_argument, NULL, 'F' },
+        { "meter", no_argument, NULL, 'm' },
+        { "meter-pool", required_argument, NULL, 'P' },
+        { "log-file", required_argument, NULL, 'O' },
+        { "log-level", required_argument, NULL, 'L' },
+        { "record", required_argument, NULL, 'R' },
+        { "replay", required_argument, NULL, 'Y' },
+        { "replay-speed", required_argument, NULL, 'S' },
+        { "lazy-ports", no_argument, NULL, 'Z' },
+        { "filter", required_argument, NULL, 'X' },
+        { "filter-file", required_argument, NULL, 'C' },
+        { "daemon", no_argument, NULL, 'D' },
+        { "socket", required_argument, NULL, 'K' },
+        { "watch", no_argument, NULL, 'W' },
+        { "json", no_argument, NULL, 'J' },
+        { "metrics", required_argument, NULL, 'M' },
+        { "lock-profile", optional_argument, NULL, 'Q' },
+        { "curve", required_argument, NULL, 'V' },
+        { NULL, 0, NULL, 0 },
+    };
 
-    if (props == NULL)
-        return;
-    if (spa_streq(type, PW_TYPE_INTERFACE_Node)) {
-        if ((str = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS)) == NULL)
-            return;
-        log_debug("found node#%d type:%s", id, str);
-        info = &node_info;
-    } else if (spa_streq(type, PW_TYPE_INTERFACE_Device)) {
-        if ((str = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS)) == NULL)
-            return;
-        log_debug("found device#%d type:%s", id, str);
-        info = &device_info;
-    } else if (spa_streq(type, PW_TYPE_INTERFACE_Metadata)) {
-        if ((str = spa_dict_lookup(props, PW_KEY_METADATA_NAME)) == NULL ||
-            !spa_streq(str, "default"))
-        {
-            return;
+    while ((c = getopt_long(argc, argv, "+hf:m", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'h':
+            show_help(argv[0]);
+            return 0;
+        case 'f':
+            fps = atoi(optarg);
+            if (fps <= 0) {
+                fprintf(stderr, "invalid fps: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'F':
+            fade_in = atoi(optarg);
+            if (fade_in < 0) {
+                fprintf(stderr, "invalid fade-in: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'm':
+            meters = true;
+            break;
+        case 'P':
+            meter_pool = atoi(optarg);
+            if (meter_pool < 0) {
+                fprintf(stderr, "invalid meter-pool: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'O':
+            log_path = optarg;
+            break;
+        case 'M':
+            metrics_path = optarg;
+            break;
+        case 'V':
+            curve_free(curve);
+            if ((curve = curve_parse(optarg, VOLUME_FULL, VOLUME_MAX)) == NULL) {
+                fprintf(stderr, "invalid curve: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'Q':
+            lock_profile = true;
+            if (optarg) {
+                lock_threshold = strtol(optarg, &end, 10);
+                if (*end || lock_threshold < 0) {
+                    fprintf(stderr, "invalid lock-profile: %s\n", optarg);
+                    return -1;
+                }
+            }
+            break;
+        case 'L':
+            log_level_arg = log_parse_level(optarg);
+            if (log_level_arg < 0) {
+                fprintf(stderr, "invalid log-level: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'R':
+            record_path = optarg;
+            break;
+        case 'Y':
+            replay_path = optarg;
+            break;
+        case 'S':
+            replay_speed = strtod(optarg, &end);
+            if (*end || replay_speed < 0) {
+                fprintf(stderr, "invalid replay-speed: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'Z':
+            lazy_ports = true;
+            break;
+        case 'X':
+        case 'C':
+            if (filter == NULL && (filter = filter_new()) == NULL) {
+                fprintf(stderr, "out of memory\n");
+                return -1;
+            }
+            if (c == 'X' && filter_add(filter, optarg) < 0) {
+                fprintf(stderr, "invalid filter: %s\n", optarg);
+                return -1;
+            }
+            if (c == 'C' && (res = filter_load(filter, optarg, &line)) < 0) {
+                if (res == -EINVAL)
+                    fprintf(stderr, "%s:%d: invalid filter\n", optarg, line);
+                else
+                    fprintf(stderr, "cannot read %s: %s\n", optarg, strerror(-res));
+                return -1;
+            }
+            break;
+        case 'D':
+            daemon = true;
+            break;
+        case 'W':
+            watch = true;
+            break;
+        case 'J':
+            json = true;
+            break;
+        case 'K':
+            if (strlen(optarg) >= sizeof(socket_path)) {
+                fprintf(stderr, "socket path too long: %s\n", optarg);
+                return -1;
+            }
+            strcpy(socket_path, optarg);
+            break;
+        default:
+            show_help(argv[0]);
+            return -1;
         }
-        log_debug("found metadata#%d name:%s", id, str);
-        info = &metadata_info;
-    } else if (spa_streq(type, PW_TYPE_INTERFACE_Link)) {
-        log_debug("found link#%d", id);
-        info = &link_info;
-    } else if (spa_streq(type, PW_TYPE_INTERFACE_Port)) {
-        log_debug("found port#%d", id);
-        info = &port_info;
-    } else
-        return;
+    }
 
-    proxy = pw_registry_bind(ctl->registry, id,
-        info->type, info->version, sizeof(struct intf));
-    intf = pw_proxy_get_user_data(proxy);
-    intf->ctl = ctl;
-    intf->id = id;
-    intf->perms = permissions;
-    intf->props = props ? pw_properties_new_dict(props) : NULL;
-    intf->proxy = proxy;
-    intf->info = info;
-    spa_list_append(&ctl->refs, &intf->ref);
-    ctl->n_refs++;
+    if (record_path && replay_path) {
+        fprintf(stderr, "cannot record and replay at the same time\n");
+        return -1;
+    }
 
-    pw_proxy_add_listener(proxy,
-        &intf->proxy_listener,
-        &proxy_events, intf);
+    if ((daemon || watch) && optind < argc) {
+        fprintf(stderr, "--daemon and --watch cannot run commands\n");
+        return -1;
+    }
+    if (daemon && replay_path) {
+        fprintf(stderr, "--daemon cannot replay\n");
+        return -1;
+    }
+    if (watch && !json) {
+        fprintf(stderr, "--watch needs --json, the only format it writes\n");
+        return -1;
+    }
+    if (daemon && socket_path[0] == '\0') {
+        if (getenv("XDG_RUNTIME_DIR"))
+            snprintf(socket_path, sizeof(socket_path), "%s/pwmixer.sock",
+                getenv("XDG_RUNTIME_DIR"));
+        else
+            snprintf(socket_path, sizeof(socket_path), "/tmp/pwmixer-%u.sock",
+                (unsigned)getuid());
+    }
 
-    if (info->events != NULL) {
-        pw_proxy_add_object_listener(proxy,
-            &intf->object_listener,
-            info->events, intf);
+    if (optind < argc) {
+        if (replay_path) {
+            fprintf(stderr, "cannot run commands against a replay\n");
+            return -1;
+        }
+        if ((script = script_new()) == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return -1;
+        }
+        if (spa_streq(argv[optind], "apply")) {
+            if (argc - optind != 2) {
+                fprintf(stderr, "usage: %s apply FILE\n", argv[0]);
+                return -1;
+            }
+            if ((res = script_load(script, argv[optind + 1], &line)) < 0) {
+                if (res == -EINVAL)
+                    fprintf(stderr, "%s:%d: invalid command\n", argv[optind + 1], line);
+                else
+                    fprintf(stderr, "cannot read %s: %s\n", argv[optind + 1], strerror(-res));
+                return -1;
+            }
+        } else if (script_add(script, argc - optind, argv + optind) < 0) {
+            fprintf(stderr, "invalid command: %s\n", argv[optind]);
+            show_help(argv[0]);
+            return -1;
+        }
+        for (c = 0; c < script->length && json; c++)
+            script->commands[c].json = true;
     }
 
-    if (info->init)
-        info->init(intf);
-}
+    /* the daemon takes these from its loop, block them before the log
+     * thread or any other is spawned */
+    if (daemon || watch) {
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    }
 
-static const struct pw_registry_events registry_events = {
-    PW_VERSION_REGISTRY,
-    .global = registry_event_global,
-};
+    // init
+    if (log_init(log_path, log_level_arg, LOG_RECORDS) < 0) {
+        fprintf(stderr, "cannot open log file %s: %s\n", log_path, strerror(errno));
+        return -1;
+    }
 
-int main(int argc, char *argv[])
-{
-    struct ctl ctl;
-    struct pw_loop *loop;
+    ctl = ctl_new();
+    if (ctl == NULL) {
+        log_error("cannot allocate ctl");
+        filter_free(filter);
+        curve_free(curve);
+        res = -ENOMEM;
+        goto done;
+    }
+    /* ctl_free() takes care of these from here on */
+    ctl->filter = filter;
+    if (curve != NULL) {
+        curve_free(ctl->curve);
+        ctl->curve = curve;
+    }
+
+    res = -1;
+    if (record_path && (ctl->journal = journal_open(record_path, true)) == NULL) {
+        fprintf(stderr, "cannot record to %s: %s\n", record_path, strerror(errno));
+        goto done;
+    }
+    if (replay_path && (ctl->replay = journal_open(replay_path, false)) == NULL) {
+        fprintf(stderr, "cannot replay %s: %s\n", replay_path, strerror(errno));
+        goto done;
+    }
+    ctl->replay_speed = replay_speed;
+    /* commands and clients never look at ports or links */
+    ctl->lazy_ports = lazy_ports || script != NULL || daemon || watch;
+    ctl->batch = script != NULL || daemon || watch;
+    ctl->watch = watch;
+    ctl->metrics_path = metrics_path;
+    ctl->lock_profile = lock_profile;
+    ctl->lock_threshold = lock_threshold * SPA_NSEC_PER_MSEC;
+    ctl->loop_site.name = "pipewire loop";
+
+    // route SIGWINCH and SIGUSR1 to the ui loop, block them before any
+    // thread is spawned
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    ctl->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (ctl->signal_fd < 0) {
+        log_error("cannot create signalfd");
+        goto done;
+    }
 
-    // init
-    log_file = fopen("pwmixer.log", "w");
     pw_init(NULL, NULL);
-    ctl.cursor = 0;
-    ctl.n_refs = 0;
-    ctl.metadata = NULL;
-    ctl.node_flags = NODE_FLAG_SINK;
-    ctl.volume_method = VOLUME_METHOD_CUBIC;
-    spa_list_init(&ctl.refs);
-
-    ctl.mainloop = pw_thread_loop_new("pwmixer", NULL);
-    loop = pw_thread_loop_get_loop(ctl.mainloop);
-    ctl.system = loop->system;
-    ctl.fd = spa_system_eventfd_create(ctl.system, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
-    if (ctl.fd < 0) {
-        log_debug("cannot create eventfd");
-        return -ctl.fd;
-    }
-
-    ctl.context = pw_context_new(loop, NULL, 0);
-
-    pw_thread_loop_lock(ctl.mainloop);
-    pw_thread_loop_start(ctl.mainloop);
-
-    ctl.core = pw_context_connect(ctl.context, NULL, 0);
-    if (ctl.core == NULL) {
-        log_debug("pw_core create failed");
-        return -errno;
+    dsp_init();
+    ctl->frame_interval = SPA_NSEC_PER_SEC / fps;
+    ctl->fade_in = fade_in * SPA_NSEC_PER_MSEC;
+    ctl->meters = meters;
+    ctl->meter_pool = calloc(meter_pool, sizeof(struct meter));
+    ctl->n_meter_pool = ctl->meter_pool ? meter_pool : 0;
+    for (c = 0; c < (int)ctl->n_meter_pool; c++)
+        ctl->meter_pool[c].ctl = ctl;
+
+    ctl->mainloop = pw_thread_loop_new("pwmixer", NULL);
+    loop = pw_thread_loop_get_loop(ctl->mainloop);
+    ctl->loop = loop;
+    if (lock_profile)
+        pw_loop_add_hook(loop, &ctl->loop_hook, &loop_hooks, ctl);
+    ctl->fade_timer = pw_loop_add_timer(loop, on_fade_timeout, ctl);
+    if (!ctl->batch)
+        ctl->publish_timer = pw_loop_add_timer(loop, on_publish_timeout, ctl);
+    if (daemon || watch)
+        ctl->events_source = pw_loop_add_event(loop, on_events_flush, ctl);
+    if (metrics_path) {
+        ctl->metrics_timer = pw_loop_add_timer(loop, on_metrics_timeout, ctl);
+        pw_loop_update_timer(loop, ctl->metrics_timer, &interval, &interval, false);
+    }
+    ctl->system = loop->system;
+    ctl->fd = spa_system_eventfd_create(ctl->system, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+    if (ctl->fd < 0) {
+        log_error("cannot create eventfd");
+        goto done;
     }
 
-    ctl.registry = pw_core_get_registry(ctl.core, PW_VERSION_REGISTRY, 0);
-    if (ctl.registry == NULL) {
-        log_debug("pw_registry create failed");
-        return -errno;
+    if (ctl->replay != NULL)
+        ctl->replay_timer = pw_loop_add_timer(loop, on_replay_timeout, ctl);
+    else
+        ctl->context = pw_context_new(loop, NULL, 0);
+
+    lock_loop(ctl);
+    pw_thread_loop_start(ctl->mainloop);
+
+    if (ctl->replay != NULL) {
+        ctl->replay_start = get_time_ns();
+        /* a replay has no server to sync with */
+        ctl->settled = true;
+        arm_replay(ctl, 0);
+    } else if ((c = connect_server(ctl)) < 0) {
+        fprintf(stderr, "cannot connect: %s\n", spa_strerror(c));
+        /* ctl_free() stops the loop, which needs the lock to exit */
+        unlock_loop(ctl);
+        goto done;
+    } else if (ctl->batch) {
+        settle(ctl);
     }
-    pw_registry_add_listener(ctl.registry, &ctl.registry_listener,
-        &registry_events, &ctl);
 
-    pw_thread_loop_unlock(ctl.mainloop);
+    unlock_loop(ctl);
+
+    if (script != NULL) {
+        res = run_script(ctl, script) < 0 ? -1 : 0;
+        goto done;
+    }
+    if (daemon || watch) {
+        res = run_daemon(ctl, daemon ? socket_path : NULL) < 0 ? -1 : 0;
+        log_latency(ctl, NULL);
+        goto done;
+    }
 
     // init curses
-    init_curses(&ctl);
+    if (ctl_screen_open(ctl, stdout, stdin) < 0) {
+        log_error("cannot open screen");
+        goto done;
+    }
 
     // run curses
-    run_curses(&ctl);
+    run_curses(ctl);
 
     // clean up
-    endwin();
-    fclose(log_file);
-
-    return 0;
+    ctl_screen_close(ctl);
+    log_latency(ctl, NULL);
+    log_info("volume/mute changes: %u requested, %u sent, %u coalesced",
+        ctl->n_requested, ctl->n_flushed, ctl->n_coalesced);
+    log_info("properties: %d interned strings in %zu bytes",
+        ctl->intern->length, ctl->intern->bytes);
+    res = 0;
+
+done:
+    script_free(script);
+    ctl_free(ctl);
+    /* not from atexit(), the loop thread may still log until ctl_free()
+     * stopped it */
+    log_deinit();
+    return res;
 }
+#endif
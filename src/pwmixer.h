@@ -0,0 +1,58 @@
+#ifndef PWMIXER_H
+#define PWMIXER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <spa/utils/dict.h>
+#include <spa/pod/pod.h>
+
+/* entry points into the mixer model that do not need a server, so the
+ * registry and object events can be fed from somewhere else than a
+ * PipeWire connection; objects added this way have no proxy and never
+ * talk back to the server */
+
+struct ctl;
+struct intf;
+struct journal;
+
+struct ctl *ctl_new(void);
+
+void ctl_free(struct ctl *ctl);
+
+/* registry global, returns NULL for objects the mixer does not track */
+struct intf *ctl_add_global(struct ctl *ctl, uint32_t id,
+    uint32_t permissions, const char *type, uint32_t version,
+    const struct spa_dict *props);
+
+int ctl_remove_global(struct ctl *ctl, uint32_t id);
+
+/* keep ports and links from their globals alone, without a proxy or a
+ * copy of their properties; must be set before the first global */
+void ctl_set_lazy_ports(struct ctl *ctl, bool lazy);
+
+/* bytes held by the interned property table */
+size_t ctl_props_size(struct ctl *ctl, uint32_t *n_strings);
+
+/* info must be the pw_*_info matching the type of object id */
+int ctl_emit_info(struct ctl *ctl, uint32_t id, const void *info);
+
+int ctl_emit_param(struct ctl *ctl, uint32_t id, uint32_t param_id,
+    const struct spa_pod *param);
+
+int ctl_emit_property(struct ctl *ctl, uint32_t id, uint32_t subject,
+    const char *key, const char *type, const char *value);
+
+/* feed journal records stamped at or before until, at most max of them,
+ * returns how many were fed or a negative errno for a corrupt journal */
+int ctl_replay(struct ctl *ctl, struct journal *journal,
+    uint64_t until, uint32_t max);
+
+int ctl_screen_open(struct ctl *ctl, FILE *out, FILE *in);
+
+void ctl_screen_render(struct ctl *ctl);
+
+void ctl_screen_close(struct ctl *ctl);
+
+#endif
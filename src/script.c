@@ -0,0 +1,195 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "script.h"
+
+#define INITIAL_CAP 4
+#define MAX_LINE 1024
+#define MAX_ARGS 8
+
+struct script *script_new(void)
+{
+    return calloc(1, sizeof(struct script));
+}
+
+static struct script_command *add_command(struct script *script)
+{
+    struct script_command *commands;
+    int capacity;
+
+    if (script->length == script->capacity) {
+        capacity = script->capacity ? script->capacity * 2 : INITIAL_CAP;
+        commands = realloc(script->commands, capacity * sizeof(struct script_command));
+        if (!commands)
+            return NULL;
+        script->commands = commands;
+        script->capacity = capacity;
+    }
+    return memset(&script->commands[script->length], 0, sizeof(struct script_command));
+}
+
+/* N, N%, +N% or -N% */
+static int parse_volume(struct script_command *command, const char *str)
+{
+    char *end;
+    long val;
+
+    command->relative = *str == '+' || *str == '-';
+    val = strtol(str, &end, 10);
+    if (end == str || (*end == '%' && *++end) || *end)
+        return -EINVAL;
+    if ((!command->relative && val < 0) ||
+        val < -SCRIPT_VOLUME_MAX || val > SCRIPT_VOLUME_MAX)
+        return -EINVAL;
+    command->volume = val;
+    return 0;
+}
+
+static int parse_mute(struct script_command *command, const char *str)
+{
+    if (strcmp(str, "on") == 0)
+        command->mute = 1;
+    else if (strcmp(str, "off") == 0)
+        command->mute = 0;
+    else if (strcmp(str, "toggle") == 0)
+        command->mute = -1;
+    else
+        return -EINVAL;
+    return 0;
+}
+
+static int parse_command(struct script_command *command, int argc, char *argv[])
+{
+    const char *target = NULL;
+
+    memset(command, 0, sizeof(*command));
+    if (argc < 1)
+        return -EINVAL;
+
+    if (strcmp(argv[0], "list") == 0) {
+        command->op = SCRIPT_LIST;
+        if (argc == 2 && strcmp(argv[1], "--json") == 0)
+            command->json = true;
+        else if (argc != 1)
+            return -EINVAL;
+    } else if (strcmp(argv[0], "get") == 0) {
+        command->op = SCRIPT_GET;
+        if (argc > 2)
+            return -EINVAL;
+        if (argc == 2)
+            target = argv[1];
+    } else if (strcmp(argv[0], "set-volume") == 0 || strcmp(argv[0], "set") == 0) {
+        command->op = SCRIPT_SET_VOLUME;
+        if (argc < 2 || argc > 3 || parse_volume(command, argv[argc - 1]) < 0)
+            return -EINVAL;
+        if (argc == 3)
+            target = argv[1];
+    } else if (strcmp(argv[0], "mute") == 0) {
+        command->op = SCRIPT_MUTE;
+        command->mute = -1;
+        if (argc > 3 || (argc == 3 && parse_mute(command, argv[2]) < 0))
+            return -EINVAL;
+        /* mute on/off mean the default sink, not a node called on */
+        if (argc == 3 || (argc == 2 && parse_mute(command, argv[1]) < 0))
+            target = argv[1];
+    } else if (strcmp(argv[0], "unmute") == 0) {
+        command->op = SCRIPT_MUTE;
+        command->mute = 0;
+        if (argc > 2)
+            return -EINVAL;
+        if (argc == 2)
+            target = argv[1];
+    } else {
+        return -EINVAL;
+    }
+
+    if (target && !(command->target = strdup(target)))
+        return -ENOMEM;
+    return 0;
+}
+
+int script_add(struct script *script, int argc, char *argv[])
+{
+    struct script_command *command;
+    int res;
+
+    if (!(command = add_command(script)))
+        return -ENOMEM;
+    if ((res = parse_command(command, argc, argv)) < 0) {
+        script_command_clear(command);
+        return res;
+    }
+    script->length++;
+    return 0;
+}
+
+int script_parse_line(struct script_command *command, char *line)
+{
+    char *argv[MAX_ARGS], *tok, *save;
+    int argc = 0;
+
+    for (tok = strtok_r(line, " \t\r\n", &save); tok;
+        tok = strtok_r(NULL, " \t\r\n", &save))
+    {
+        if (argc == 0 && *tok == '#')
+            break;
+        if (argc == MAX_ARGS)
+            return -EINVAL;
+        argv[argc++] = tok;
+    }
+    if (argc == 0)
+        return 0;
+    if (parse_command(command, argc, argv) < 0) {
+        script_command_clear(command);
+        return -EINVAL;
+    }
+    return 1;
+}
+
+void script_command_clear(struct script_command *command)
+{
+    free(command->target);
+    command->target = NULL;
+}
+
+int script_load(struct script *script, const char *path, int *line)
+{
+    struct script_command *command;
+    char buf[MAX_LINE];
+    FILE *file;
+    int res = 0;
+
+    *line = 0;
+    if (strcmp(path, "-") == 0)
+        file = stdin;
+    else if (!(file = fopen(path, "r")))
+        return -errno;
+
+    while (fgets(buf, sizeof(buf), file)) {
+        (*line)++;
+        if (!(command = add_command(script))) {
+            res = -ENOMEM;
+            break;
+        }
+        if ((res = script_parse_line(command, buf)) < 0)
+            break;
+        script->length += res;
+        res = 0;
+    }
+    if (res == 0 && ferror(file))
+        res = -EIO;
+    if (file != stdin)
+        fclose(file);
+    return res;
+}
+
+void script_free(struct script *script)
+{
+    if (!script)
+        return;
+    for (int i = 0; i < script->length; i++)
+        free(script->commands[i].target);
+    free(script->commands);
+    free(script);
+}
@@ -0,0 +1,67 @@
+#ifndef PWMIXER_SCRIPT_H
+#define PWMIXER_SCRIPT_H
+
+#include <stdbool.h>
+
+/* commands run without the curses front-end, given on the command line
+ * or one per line in a file:
+ *
+ *   list [--json]                      print the sinks, sources and streams
+ *   get [TARGET]                       print one node as json
+ *   set-volume [TARGET] VOLUME         VOLUME is N% or +N%/-N% to step,
+ *                                      set is the same
+ *   mute [TARGET] [on|off|toggle]      toggles when no state is given, a
+ *                                      lone on, off or toggle is the state
+ *   unmute [TARGET]
+ *
+ * TARGET is a node id, a node.name, @DEFAULT_SINK@ or @DEFAULT_SOURCE@
+ * and is the default sink when left out */
+
+#define SCRIPT_DEFAULT_SINK     "@DEFAULT_SINK@"
+#define SCRIPT_DEFAULT_SOURCE   "@DEFAULT_SOURCE@"
+/* percent, no node goes higher and neither do steps */
+#define SCRIPT_VOLUME_MAX       1000
+
+enum script_op {
+    SCRIPT_LIST,
+    SCRIPT_GET,
+    SCRIPT_SET_VOLUME,
+    SCRIPT_MUTE,
+};
+
+struct script_command {
+    enum script_op op;
+    char *target;
+    /* percent, or a step in percent when relative */
+    int volume;
+    bool relative;
+    /* 1 or 0, -1 to toggle */
+    int mute;
+    bool json;
+};
+
+struct script {
+    struct script_command *commands;
+    int length;
+    int capacity;
+};
+
+struct script *script_new(void);
+
+/* splits line in place, returns 0 for a blank line or a comment, 1 when
+ * command was filled in and -EINVAL when it does not parse */
+int script_parse_line(struct script_command *command, char *line);
+
+void script_command_clear(struct script_command *command);
+
+/* argv[0] is the command name, returns -EINVAL for a command that does
+ * not parse */
+int script_add(struct script *script, int argc, char *argv[]);
+
+/* blank lines and lines starting with # are skipped; on a bad command
+ * -EINVAL is returned and line is set */
+int script_load(struct script *script, const char *path, int *line);
+
+void script_free(struct script *script);
+
+#endif
@@ -0,0 +1,62 @@
+#include <string.h>
+#include "vec.h"
+
+int vec_append(struct vec *vec, struct pool *pool, void *item)
+{
+    uint32_t capacity = vec->capacity > VEC_INLINE ? vec->capacity : VEC_INLINE;
+    void **data;
+
+    if (vec->length == capacity) {
+        capacity *= 2;
+        if (!(data = pool_alloc(pool, capacity * sizeof(void*))))
+            return -1;
+        memcpy(data, vec_data(vec), vec->length * sizeof(void*));
+        if (vec->capacity > VEC_INLINE)
+            pool_release(pool, vec->heap, vec->capacity * sizeof(void*));
+        vec->heap = data;
+        vec->capacity = capacity;
+    }
+
+    vec_data(vec)[vec->length++] = item;
+    return vec->length;
+}
+
+int vec_find_index(struct vec *vec, void *item)
+{
+    void **data = vec_data(vec);
+
+    for (uint32_t i = 0; i < vec->length; i++) {
+        if (data[i] == item)
+            return i;
+    }
+    return -1;
+}
+
+int vec_swap_remove(struct vec *vec, uint32_t index)
+{
+    void **data = vec_data(vec);
+
+    if (index >= vec->length)
+        return -1;
+    data[index] = data[--vec->length];
+    return vec->length;
+}
+
+int vec_remove(struct vec *vec, uint32_t index)
+{
+    void **data = vec_data(vec);
+
+    if (index >= vec->length)
+        return -1;
+    memmove(&data[index], &data[index + 1],
+        (--vec->length - index) * sizeof(void*));
+    return vec->length;
+}
+
+void vec_clear(struct vec *vec, struct pool *pool)
+{
+    if (vec->capacity > VEC_INLINE)
+        pool_release(pool, vec->heap, vec->capacity * sizeof(void*));
+    vec->length = 0;
+    vec->capacity = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef PWMIXER_VEC_H
+#define PWMIXER_VEC_H
+
+#include <stdint.h>
+#include "pool.h"
+
+/* vector of pointers keeping its first VEC_INLINE items in place and
+ * spilling into blocks from a pool beyond that; a zeroed vec is empty
+ * and ready to use. vec_swap_remove() swaps the last item in and does
+ * not keep the order of the items, vec_remove() does */
+
+#define VEC_INLINE 4
+
+struct vec {
+    uint32_t length;
+    uint32_t capacity;
+    union {
+        void *items[VEC_INLINE];
+        void **heap;
+    };
+};
+
+static inline void **vec_data(struct vec *vec)
+{
+    return vec->capacity > VEC_INLINE ? vec->heap : vec->items;
+}
+
+static inline void *vec_get(struct vec *vec, uint32_t index)
+{
+    return index < vec->length ? vec_data(vec)[index] : NULL;
+}
+
+int vec_append(struct vec *vec, struct pool *pool, void *item);
+
+int vec_find_index(struct vec *vec, void *item);
+
+int vec_swap_remove(struct vec *vec, uint32_t index);
+
+int vec_remove(struct vec *vec, uint32_t index);
+
+/* gives the spilled items back to the pool and empties the vec */
+void vec_clear(struct vec *vec, struct pool *pool);
+
+#endif
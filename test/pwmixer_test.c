@@ -1,6 +1,23 @@
 #include "array.h"
+#include "curve.h"
+#include "map.h"
+#include "dsp.h"
+#include "filter.h"
+#include "histogram.h"
+#include "intern.h"
+#include "journal.h"
+#include "log.h"
+#include "metrics.h"
+#include "pool.h"
+#include "script.h"
+#include "vec.h"
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 struct array_item {
     int n;
@@ -36,7 +53,677 @@ static void test_array()
     assert(array_free(arr) == 0);
 }
 
+static void test_vec()
+{
+    uint32_t i, max = 100;
+    struct array_item aitem[max];
+    struct pool *pool = pool_new();
+    struct vec vec = { 0 };
+    void *blocks[1100];
+    size_t n_slabs;
+
+    assert(vec.length == 0 && vec_get(&vec, 0) == NULL);
+    assert(vec_find_index(&vec, &aitem[0]) == -1);
+
+    for (i = 0; i < VEC_INLINE; i++) {
+        aitem[i].n = i;
+        assert(vec_append(&vec, pool, &aitem[i]) == i + 1);
+    }
+    /* nothing comes from the pool while the items fit in place */
+    assert(pool->n_blocks == 0 && pool->n_slabs == 0);
+
+    for (; i < max; i++) {
+        aitem[i].n = i;
+        assert(vec_append(&vec, pool, &aitem[i]) == i + 1);
+    }
+    assert(pool->n_blocks == 1);
+    for (i = 0; i < max; i++)
+        assert(((struct array_item*)vec_get(&vec, i))->n == aitem[i].n);
+
+    /* the last item takes the place of the removed one */
+    assert(vec_swap_remove(&vec, 5) == max - 1);
+    assert(vec_get(&vec, 5) == &aitem[max - 1]);
+    assert(vec_find_index(&vec, &aitem[5]) == -1);
+    assert(vec_find_index(&vec, &aitem[9]) == 9);
+    assert(vec_swap_remove(&vec, max) == -1);
+
+    /* the items after the one removed move up in order */
+    assert(vec_remove(&vec, 2) == max - 2);
+    assert(vec_get(&vec, 1) == &aitem[1] && vec_get(&vec, 2) == &aitem[3]);
+    assert(vec_get(&vec, max - 3) == &aitem[max - 2]);
+    assert(vec_remove(&vec, max - 2) == -1);
+
+    vec_clear(&vec, pool);
+    assert(vec.length == 0 && pool->n_blocks == 0);
+    assert(vec_append(&vec, pool, &aitem[0]) == 1);
+    assert(vec_get(&vec, 0) == &aitem[0]);
+    vec_clear(&vec, pool);
+
+    /* freed blocks are handed out again before a new slab is cut */
+    n_slabs = pool->n_slabs;
+    for (i = 0; i < 1100; i++)
+        blocks[i] = pool_alloc(pool, 16);
+    assert(pool->n_slabs == n_slabs + 2);
+    for (i = 0; i < 1100; i++)
+        pool_release(pool, blocks[i], 16);
+    assert(pool_alloc(pool, 9) == blocks[1099]);
+    blocks[0] = pool_alloc(pool, 100000);
+    assert(blocks[0] != NULL);
+    pool_release(pool, blocks[0], 100000);
+    assert(pool->n_slabs == n_slabs + 2);
+    pool_free(pool);
+}
+
+static void test_idmap()
+{
+    uint32_t i, max = 1000;
+    struct array_item aitem[max];
+    struct idmap *map = idmap_new();
+
+    assert(map->length == 0);
+    assert(idmap_get(map, 0) == NULL);
+
+    for (i = 0; i < max; i++) {
+        aitem[i].n = i;
+        assert(idmap_put(map, i * 3, &aitem[i]) == i + 1);
+    }
+    assert(idmap_put(map, 0, &aitem[1]) == max);
+    assert(idmap_get(map, 0) == &aitem[1]);
+    assert(idmap_put(map, 0, &aitem[0]) == max);
+
+    for (i = 0; i < max; i++) {
+        assert(idmap_get(map, i * 3) == &aitem[i]);
+        assert(idmap_get(map, i * 3 + 1) == NULL);
+    }
+
+    assert(idmap_remove(map, 3, &aitem[2]) == -1);
+    assert(idmap_remove(map, 1, NULL) == -1);
+    for (i = 0; i < max; i += 2)
+        assert(idmap_remove(map, i * 3, &aitem[i]) >= 0);
+    assert(map->length == max / 2);
+
+    for (i = 0; i < max; i++) {
+        if (i % 2)
+            assert(idmap_get(map, i * 3) == &aitem[i]);
+        else
+            assert(idmap_get(map, i * 3) == NULL);
+    }
+
+    assert(idmap_free(map) == 0);
+}
+
+static void test_strmap()
+{
+    uint32_t i, max = 500;
+    struct array_item aitem[max];
+    struct strmap *map = strmap_new();
+    char key[32];
+
+    assert(strmap_get(map, "none") == NULL);
+
+    for (i = 0; i < max; i++) {
+        aitem[i].n = i;
+        snprintf(key, sizeof(key), "alsa_output.%u", i);
+        assert(strmap_put(map, key, &aitem[i]) == i + 1);
+    }
+
+    for (i = 0; i < max; i++) {
+        snprintf(key, sizeof(key), "alsa_output.%u", i);
+        assert(strmap_get(map, key) == &aitem[i]);
+    }
+
+    assert(strmap_remove(map, "alsa_output.7", &aitem[8]) == -1);
+    assert(strmap_remove(map, "alsa_output.7", &aitem[7]) == max - 1);
+    assert(strmap_get(map, "alsa_output.7") == NULL);
+    assert(strmap_get(map, "alsa_output.8") == &aitem[8]);
+
+    assert(strmap_free(map) == 0);
+}
+
+static void check_level(dsp_level_func_t func, const float *samples, uint32_t n)
+{
+    float peak = 0.0f, sum_sq = 0.0f, ref_peak = 0.0f, ref_sum_sq = 0.0f;
+
+    dsp_level_c(samples, n, &ref_peak, &ref_sum_sq);
+    func(samples, n, &peak, &sum_sq);
+
+    assert(peak == ref_peak);
+    assert(fabsf(sum_sq - ref_sum_sq) <= 1e-4f * (ref_sum_sq + 1.0f));
+}
+
+static void test_dsp()
+{
+    uint32_t i, n, max = 1027;
+    float samples[max + 1], peak = 0.5f, sum_sq = 1.0f;
+
+    dsp_init();
+
+    srand(1);
+    for (i = 0; i <= max; i++)
+        samples[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    samples[500] = -1.5f;
+
+    dsp_level_c(samples, 0, &peak, &sum_sq);
+    assert(peak == 0.5f && sum_sq == 1.0f);
+
+    dsp_level(samples, max, &peak, &sum_sq);
+    assert(peak == 1.5f);
+
+    /* odd lengths and unaligned starts hit the scalar tails */
+    for (n = 0; n < 40; n++) {
+        check_level(dsp_level, samples + 1, n);
+        check_level(dsp_level, samples, max - n);
+#ifdef DSP_X86
+        check_level(dsp_level_sse2, samples + 1, max - n);
+        if (__builtin_cpu_supports("avx2"))
+            check_level(dsp_level_avx2, samples + 1, max - n);
+#endif
+    }
+}
+
+static int format_log(char *buf, size_t size, const char *format, ...)
+{
+    struct log_record record;
+    va_list args;
+
+    va_start(args, format);
+    assert(log_record_capture(&record, LOG_LEVEL_INFO, format, args) == 0);
+    va_end(args);
+    return log_record_format(&record, buf, size);
+}
+
+static void test_log()
+{
+    struct log_ring ring;
+    struct log_record record;
+    char buf[256], path[] = "/tmp/pwmixer_test_XXXXXX";
+    FILE *f;
+    int i, fd;
+
+    format_log(buf, sizeof(buf), "node#%d %s vol:%.2f %u%% %lx %5.*s|",
+        -3, "sink", 0.5, 100u, 255ul, 2, "abc");
+    assert(strcmp(buf, "node#-3 sink vol:0.50 100% ff    ab|") == 0);
+    format_log(buf, sizeof(buf), "%zu %lld %hhd %c %s", (size_t)7,
+        -(1LL << 40), 300, 'x', (char *)NULL);
+    assert(strcmp(buf, "7 -1099511627776 44 x (null)") == 0);
+    assert(format_log(buf, 8, "truncated %d", 12345) == 7);
+
+    assert(log_ring_init(&ring, 3) == 0);
+    for (i = 0; i < 4; i++) {
+        record.level = i;
+        assert(log_ring_push(&ring, &record) == 0);
+    }
+    assert(log_ring_push(&ring, &record) < 0);
+    for (i = 0; i < 4; i++) {
+        assert(log_ring_pop(&ring, &record) == 0);
+        assert(record.level == (uint32_t)i);
+    }
+    assert(log_ring_pop(&ring, &record) < 0);
+    log_ring_clear(&ring);
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    assert(log_init(path, LOG_LEVEL_INFO, 16) == 0);
+    log_info("hello %s", "world");
+    log_debug("not written %d", 1);
+    log_set_level(LOG_LEVEL_DEBUG);
+    log_debug("written %d", 2);
+    /* more arguments than a record holds */
+    log_info("too many %d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9);
+    assert(log_dropped() == 1);
+    log_deinit();
+    log_debug("after deinit");
+
+    f = fopen(path, "r");
+    assert(f != NULL);
+    i = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[i] = '\0';
+    fclose(f);
+    unlink(path);
+    assert(strstr(buf, "info  hello world\n") != NULL);
+    assert(strstr(buf, "debug written 2\n") != NULL);
+    assert(strstr(buf, "not written") == NULL);
+    assert(strstr(buf, "too many") == NULL);
+    assert(strstr(buf, "log: 1 records dropped\n") != NULL);
+    assert(log_dropped() == 1);
+}
+
+static void test_journal()
+{
+    struct journal *journal;
+    struct journal_record record;
+    char path[] = "/tmp/pwmixer_test_XXXXXX";
+    uint64_t pod[2] = { 16, 0x1234 }, v64;
+    const void *data;
+    const char *str;
+    uint32_t v32, size;
+    FILE *f;
+    int fd;
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    journal = journal_open(path, true);
+    assert(journal != NULL);
+    journal_begin(journal, 1, 100);
+    journal_put_u32(journal, 42);
+    journal_put_str(journal, "node.name");
+    journal_put_str(journal, NULL);
+    journal_put_str(journal, "");
+    journal_put_data(journal, pod, sizeof(pod));
+    assert(journal_end(journal) == 0);
+    journal_begin(journal, 2, 200);
+    journal_put_u64(journal, 1ULL << 40);
+    assert(journal_end(journal) == 0);
+    assert(journal_close(journal) == 0);
+
+    journal = journal_open(path, false);
+    assert(journal != NULL);
+    assert(journal_peek(journal, &record) == 1);
+    assert(record.type == 1 && record.time == 100);
+    assert(journal_read(journal, &record) == 1);
+    assert(record.type == 1);
+    assert(journal_get_u32(journal, &v32) == 0 && v32 == 42);
+    assert(journal_get_str(journal, &str) == 0 && strcmp(str, "node.name") == 0);
+    assert(journal_get_str(journal, &str) == 0 && str == NULL);
+    assert(journal_get_str(journal, &str) == 0 && strcmp(str, "") == 0);
+    assert(journal_get_data(journal, &data, &size) == 0);
+    assert(size == sizeof(pod) && ((uintptr_t)data & 7) == 0);
+    assert(memcmp(data, pod, size) == 0);
+    assert(journal_get_u32(journal, &v32) < 0);
+
+    assert(journal_read(journal, &record) == 1);
+    assert(record.type == 2 && record.time == 200);
+    assert(journal_get_u64(journal, &v64) == 0 && v64 == 1ULL << 40);
+    assert(journal_read(journal, &record) == 0);
+    assert(journal_close(journal) == 0);
+
+    /* a record cut short by a crash is reported, not replayed */
+    f = fopen(path, "r+b");
+    assert(f != NULL);
+    assert(ftruncate(fileno(f), 16 + 16 + 8) == 0);
+    fclose(f);
+    journal = journal_open(path, false);
+    assert(journal != NULL);
+    assert(journal_read(journal, &record) < 0);
+    journal_close(journal);
+
+    f = fopen(path, "wb");
+    fputs("not a journal", f);
+    fclose(f);
+    assert(journal_open(path, false) == NULL);
+    unlink(path);
+}
+
+static const char *lookup_props(void *data, const char *key)
+{
+    const char **props = data;
+
+    for (; props[0] != NULL; props += 2) {
+        if (strcmp(props[0], key) == 0)
+            return props[1];
+    }
+    return NULL;
+}
+
+static void test_filter()
+{
+    const char *sink[] = { "media.class", "Audio/Sink",
+        "node.name", "alsa_output.pci", "device.id", "40", NULL };
+    const char *chain[] = { "media.class", "Audio/Sink",
+        "node.name", "effect_input.eq", NULL };
+    const char *stream[] = { "media.class", "Stream/Output/Audio",
+        "node.name", "firefox", NULL };
+    char path[] = "/tmp/pwmixer_test_XXXXXX";
+    struct filter *filter = filter_new();
+    FILE *f;
+    int fd, line;
+
+    assert(filter_match(NULL, lookup_props, sink));
+    assert(filter_match(filter, lookup_props, chain));
+
+    assert(filter_add(filter, "media.class=Audio/*") == 0);
+    assert(filter_match(filter, lookup_props, sink));
+    assert(!filter_match(filter, lookup_props, stream));
+    filter_free(filter);
+
+    filter = filter_new();
+    assert(filter_add(filter, "node.name!~^effect_") == 0);
+    assert(filter_add(filter, "hardware") == 0);
+    assert(filter_match(filter, lookup_props, sink));
+    assert(!filter_match(filter, lookup_props, chain));
+    assert(filter_match(filter, lookup_props, stream));
+    assert(filter_add(filter, "media.name!=x") == 0);
+    assert(filter_match(filter, lookup_props, sink));
+    assert(filter_add(filter, "node.name") == -EINVAL);
+    assert(filter_add(filter, "=x") == -EINVAL);
+    assert(filter_add(filter, "node.name~(") == -EINVAL);
+    assert(filter->length == 3);
+    filter_free(filter);
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    f = fopen(path, "w");
+    fputs("# hosts\n\n  node.name~^alsa_  \nmedia.class!=Stream/*\n", f);
+    fclose(f);
+    filter = filter_new();
+    assert(filter_load(filter, path, &line) == 0 && line == 4);
+    assert(filter_match(filter, lookup_props, sink));
+    assert(!filter_match(filter, lookup_props, chain));
+    assert(!filter_match(filter, lookup_props, stream));
+
+    f = fopen(path, "a");
+    fputs("bogus\n", f);
+    fclose(f);
+    assert(filter_load(filter, path, &line) == -EINVAL && line == 5);
+    filter_free(filter);
+    unlink(path);
+}
+
+static void test_intern()
+{
+    struct intern *intern = intern_new();
+    const char *a, *b, *c, *strs[1000];
+    char buf[32];
+    size_t empty = intern->bytes;
+    int i;
+
+    a = intern_get(intern, "alsa_output.pci");
+    strcpy(buf, "alsa_output.pci");
+    b = intern_get(intern, buf);
+    c = intern_get(intern, "Audio/Sink");
+    assert(a == b && a != buf && strcmp(a, buf) == 0);
+    assert(a != c);
+    assert(intern->length == 2);
+    assert(intern_get(intern, NULL) == NULL);
+
+    intern_put(intern, a);
+    assert(intern->length == 2);
+    intern_put(intern, b);
+    assert(intern->length == 1);
+    intern_put(intern, NULL);
+
+    /* grow past the initial table and drain it again */
+    for (i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "node.%d", i);
+        strs[i] = intern_get(intern, buf);
+    }
+    assert(intern->length == 1001);
+    for (i = 0; i < 1000; i += 2)
+        intern_put(intern, strs[i]);
+    for (i = 1; i < 1000; i += 2) {
+        snprintf(buf, sizeof(buf), "node.%d", i);
+        assert(intern_get(intern, buf) == strs[i]);
+        intern_put(intern, strs[i]);
+        intern_put(intern, strs[i]);
+    }
+    assert(intern->length == 1);
+    assert(intern_get(intern, "Audio/Sink") == c);
+    intern_put(intern, c);
+    intern_put(intern, c);
+    assert(intern->length == 0);
+    assert(intern->bytes > empty);
+    intern_free(intern);
+}
+
+static void test_script()
+{
+    char *set[] = { "set-volume", "alsa_output.pci", "40%" };
+    char *step[] = { "set-volume", "-5%" };
+    char *mute[] = { "mute", "42", "on" };
+    char *mute_off[] = { "mute", "off" };
+    char *list[] = { "list", "--json" };
+    char *bad[][3] = {
+        { "set-volume", "x", "40%x" }, { "set-volume", "x", "-" },
+        { "mute", "x", "maybe" }, { "list", "--yaml" }, { "apply", "x" },
+        { "set-volume", "x", "1001%" }, { "set-volume", "x", "-4294967296%" },
+    };
+    char path[] = "/tmp/pwmixer_test_XXXXXX";
+    struct script *script = script_new();
+    struct script_command *c, command;
+    char buf[64];
+    FILE *f;
+    int fd, i, line;
+
+    assert(script_add(script, 3, set) == 0);
+    assert(script_add(script, 2, step) == 0);
+    assert(script_add(script, 3, mute) == 0);
+    assert(script_add(script, 2, list) == 0);
+    assert(script_add(script, 1, list) == 0);
+    assert(script_add(script, 2, mute_off) == 0);
+    for (i = 0; i < 7; i++)
+        assert(script_add(script, 3, bad[i]) == -EINVAL);
+    assert(script->length == 6);
+
+    c = script->commands;
+    assert(c[0].op == SCRIPT_SET_VOLUME && c[0].volume == 40 && !c[0].relative);
+    assert(strcmp(c[0].target, "alsa_output.pci") == 0);
+    assert(c[1].volume == -5 && c[1].relative && c[1].target == NULL);
+    assert(c[2].op == SCRIPT_MUTE && c[2].mute == 1 && strcmp(c[2].target, "42") == 0);
+    assert(c[3].op == SCRIPT_LIST && c[3].json && !c[4].json);
+    assert(c[5].op == SCRIPT_MUTE && c[5].mute == 0 && c[5].target == NULL);
+    script_free(script);
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    f = fopen(path, "w");
+    fputs("# hotkey\n\n  mute @DEFAULT_SOURCE@\nunmute\tspeakers\nset-volume +10\n", f);
+    fclose(f);
+    script = script_new();
+    assert(script_load(script, path, &line) == 0 && line == 5);
+    assert(script->length == 3);
+    c = script->commands;
+    assert(c[0].mute == -1 && strcmp(c[0].target, SCRIPT_DEFAULT_SOURCE) == 0);
+    assert(c[1].mute == 0 && strcmp(c[1].target, "speakers") == 0);
+    assert(c[2].volume == 10 && c[2].relative);
+
+    f = fopen(path, "a");
+    fputs("set-volume\n", f);
+    fclose(f);
+    assert(script_load(script, path, &line) == -EINVAL && line == 6);
+    script_free(script);
+    unlink(path);
+
+    /* one request at a time, as the daemon reads them */
+    strcpy(buf, "  set 42 +3%\r\n");
+    assert(script_parse_line(&command, buf) == 1);
+    assert(command.op == SCRIPT_SET_VOLUME && command.volume == 3 && command.relative);
+    assert(strcmp(command.target, "42") == 0);
+    script_command_clear(&command);
+    strcpy(buf, "get");
+    assert(script_parse_line(&command, buf) == 1);
+    assert(command.op == SCRIPT_GET && command.target == NULL);
+    strcpy(buf, " # nothing");
+    assert(script_parse_line(&command, buf) == 0);
+    strcpy(buf, "get a b");
+    assert(script_parse_line(&command, buf) == -EINVAL);
+    assert(command.target == NULL);
+}
+
+static void test_histogram()
+{
+    struct histogram hist;
+    uint64_t v, p50, p99;
+    uint32_t i;
+
+    histogram_reset(&hist);
+    assert(histogram_percentile(&hist, 0.5) == 0);
+
+    /* every bucket starts right where the one before ends */
+    for (i = 1; i < HISTOGRAM_BUCKETS; i++) {
+        assert(histogram_bucket_start(i) > histogram_bucket_start(i - 1));
+        assert(histogram_bucket(histogram_bucket_start(i)) == i);
+        assert(histogram_bucket(histogram_bucket_start(i) - 1) == i - 1);
+    }
+    assert(histogram_bucket(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+
+    for (v = 1; v <= 10000; v++)
+        histogram_record(&hist, v * 1000);
+    assert(hist.count == 10000);
+    assert(hist.max == 10000000);
+
+    p50 = histogram_percentile(&hist, 0.5);
+    p99 = histogram_percentile(&hist, 0.99);
+    assert(p50 >= 5000000 && p50 <= 5000000 + 5000000 / HISTOGRAM_SUB);
+    assert(p99 >= 9900000 && p99 <= 10000000);
+    assert(histogram_percentile(&hist, 1.0) == 10000000);
+
+    histogram_record(&hist, 0);
+    assert(histogram_percentile(&hist, 0.0) == 0);
+}
+
+static void test_metrics()
+{
+    struct metrics metrics = { 0 };
+    char path[] = "/tmp/pwmixer_test_XXXXXX", buf[4096];
+    size_t len;
+    FILE *file;
+    int fd;
+
+    metrics_add(&metrics, METRIC_GLOBALS_BOUND, 3);
+    metrics_add(&metrics, METRIC_INFO_PORT, 1);
+    metrics_add(&metrics, METRIC_INFO_PORT, 1);
+    metrics_add(&metrics, METRIC_LOCK_WAIT, 1500000000);
+    metrics_set(&metrics, METRIC_TERMINAL_BYTES, 42);
+    assert(metrics_get(&metrics, METRIC_INFO_PORT) == 2);
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    assert(metrics_write(&metrics, path) == 0);
+
+    file = fopen(path, "r");
+    assert(file != NULL);
+    len = fread(buf, 1, sizeof(buf) - 1, file);
+    buf[len] = '\0';
+    fclose(file);
+    unlink(path);
+
+    assert(strstr(buf, "# TYPE pwmixer_globals_bound_total counter\n"
+        "pwmixer_globals_bound_total 3\n"));
+    assert(strstr(buf, "pwmixer_info_events_total{type=\"node\"} 0\n"));
+    assert(strstr(buf, "pwmixer_info_events_total{type=\"port\"} 2\n"));
+    assert(strstr(buf, "pwmixer_lock_wait_seconds_total 1.500000000\n"));
+    assert(strstr(buf, "pwmixer_terminal_bytes_total 42\n"));
+    /* labelled metrics share one description */
+    assert(strstr(strstr(buf, "# TYPE pwmixer_info_events_total") + 1,
+        "# TYPE pwmixer_info_events_total") == NULL);
+
+    assert(metrics_write(&metrics, "/nonexistent/pwmixer.prom") == -ENOENT);
+}
+
+/* the tables against the math they stand for, over every position and
+ * over gains spread across the whole range */
+static void check_curve(struct curve *curve, double (*eval)(double),
+    double (*invert)(double), double slack)
+{
+    uint32_t v, volumes[64], n = 0;
+    float gain, gains[64];
+    double ref;
+
+    assert(curve != NULL);
+    for (v = 0; v <= curve->max; v++) {
+        ref = eval((double)v / curve->full);
+        gain = curve_to_linear(curve, v);
+        /* relative, the gains near 0 are tiny for the steep curves */
+        if (v < CURVE_FORWARD_EXACT)
+            assert(fabs(gain - ref) <= 1e-6 * ref);
+        else
+            assert(fabs(invert(gain) * curve->full - v) <= 0.5);
+        /* every position maps back to itself, bar the corners the slack
+         * past rounding allows for */
+        assert(abs((int)curve_from_linear(curve, gain) - (int)v) <= slack - 1.0);
+    }
+    for (gain = CURVE_MIN_GAIN; gain < curve->max_gain; gain *= 1.01f) {
+        ref = invert(gain) * curve->full;
+        if (ref > curve->max)
+            ref = curve->max;
+        assert(fabs((double)curve_from_linear(curve, gain) - ref) <= slack);
+    }
+    assert(curve_from_linear(curve, 0.0f) == 0);
+    assert(curve_from_linear(curve, -1.0f) == 0);
+    assert(curve_from_linear(curve, NAN) == 0);
+    assert(curve_from_linear(curve, 1e30f) == curve_from_linear(curve, curve->max_gain));
+    assert(curve_from_linear(curve, INFINITY) == curve_from_linear(curve, curve->max_gain));
+    assert(curve_to_linear(curve, curve->max + 100) == curve_to_linear(curve, curve->max));
+
+    /* the batch calls give what the single ones do */
+    for (v = 0; v < 64; v++) {
+        volumes[v] = v * 613 % (curve->max + 1);
+        gains[v] = curve_to_linear(curve, volumes[v]);
+    }
+    curve_from_linear_n(curve, gains, volumes, 64);
+    for (v = 0; v < 64; v++) {
+        n += volumes[v] != curve_from_linear(curve, gains[v]);
+        gains[v] = 0;
+    }
+    assert(n == 0);
+    curve_to_linear_n(curve, volumes, gains, 64);
+    for (v = 0; v < 64; v++)
+        assert(gains[v] == curve_to_linear(curve, volumes[v]));
+    curve_free(curve);
+}
+
+static double linear(double p) { return p; }
+static double cubic(double p) { return p * p * p; }
+static double cubic_inv(double g) { return cbrt(g); }
+static double db30(double p) { return p > 1 ? cubic(p) : p > 0 ? pow(10.0, -30.0 * (1.0 - p) / 20.0) : 0; }
+static double db30_inv(double g) { return g > 1 ? cbrt(g) : fmax(0.0, 1.0 + 20.0 * log10(g) / 30.0); }
+static double custom(double p) { return p < 0.5 ? p * 0.2 : 0.1 + (p - 0.5) * 1.8; }
+static double custom_inv(double g) { return g < 0.1 ? g / 0.2 : 0.5 + (g - 0.1) / 1.8; }
+
+static void test_curve()
+{
+    const uint32_t full = 0x1000, max = 0xA000;
+    struct curve_point bad[2] = { { 0.0f, 1.0f }, { 1.0f, 0.5f } };
+    struct curve *curve;
+
+    check_curve(curve_new(CURVE_LINEAR, full, max), linear, linear, 1.0);
+    check_curve(curve_new(CURVE_CUBIC, full, max), cubic, cubic_inv, 1.0);
+    check_curve(curve_new_db(-30.0f, full, max), db30, db30_inv, 1.0);
+    check_curve(curve_parse("db:-30", full, max), db30, db30_inv, 1.0);
+    /* a table entry across a breakpoint cuts the corner */
+    check_curve(curve_parse("0:0,50:10,100:100", full, max), custom, custom_inv, 2.0);
+
+    /* silence down to the floor */
+    curve = curve_parse("db", full, max);
+    assert(curve != NULL && curve->floor_db == CURVE_DB_FLOOR);
+    assert(curve_to_linear(curve, 0) == 0.0f);
+    assert(curve_from_linear(curve, 1e-4f) == 0);
+    assert(curve_from_linear(curve, 1.0f) == full);
+    /* no louder past full than cubic */
+    assert(curve_to_linear(curve, 2 * full) == 8.0f);
+    assert(curve_to_linear(curve, max) <= 1000.0f);
+    curve_free(curve);
+
+    assert(curve_new_custom(bad, 2, full, max) == NULL && errno == EINVAL);
+    assert(curve_new_db(0.0f, full, max) == NULL && errno == EINVAL);
+    assert(curve_parse("db:-inf", full, max) == NULL && errno == EINVAL);
+    assert(curve_parse("db:nan", full, max) == NULL && errno == EINVAL);
+    assert(curve_parse("0:0,100:100000000", full, max) == NULL && errno == ERANGE);
+    assert(curve_parse("db:", full, max) == NULL && errno == EINVAL);
+    assert(curve_parse("cubic2", full, max) == NULL && errno == EINVAL);
+    assert(curve_parse("0:0,100", full, max) == NULL && errno == EINVAL);
+    assert(curve_parse("10:0,100:100", full, max) == NULL && errno == EINVAL);
+}
+
 int main(int argc, char *argv[])
 {
     test_array();
+    test_vec();
+    test_idmap();
+    test_strmap();
+    test_dsp();
+    test_log();
+    test_journal();
+    test_filter();
+    test_intern();
+    test_script();
+    test_histogram();
+    test_metrics();
+    test_curve();
 }
@@ -0,0 +1,39 @@
+#include "pwmixer.h"
+#include <assert.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/extensions/metadata.h>
+
+/* the model fed through the entry points --replay uses, without a
+ * server */
+
+static void test_default_cleared()
+{
+    struct spa_dict_item items[] = {
+        SPA_DICT_ITEM_INIT(PW_KEY_METADATA_NAME, "default"),
+    };
+    struct spa_dict props = SPA_DICT_INIT_ARRAY(items);
+    struct ctl *ctl = ctl_new();
+
+    assert(ctl != NULL);
+    assert(ctl_add_global(ctl, 30, PW_PERM_R, PW_TYPE_INTERFACE_Metadata,
+        PW_VERSION_METADATA, &props) != NULL);
+    assert(ctl_emit_property(ctl, 30, PW_ID_CORE, "default.audio.sink",
+        "Spa:String:JSON", "{\"name\":\"alsa_output.pci\"}") == 0);
+
+    /* a cleared default comes as NULL and is journalled as such */
+    assert(ctl_emit_property(ctl, 30, PW_ID_CORE, "default.audio.sink",
+        NULL, NULL) == 0);
+    assert(ctl_emit_property(ctl, 30, PW_ID_CORE, "default.audio.source",
+        NULL, NULL) == 0);
+    assert(ctl_emit_property(ctl, 30, PW_ID_CORE, "default.audio.sink",
+        "Spa:String:JSON", "{\"name\":\"alsa_output.usb\"}") == 0);
+    ctl_free(ctl);
+}
+
+int main(int argc, char *argv[])
+{
+    pw_init(NULL, NULL);
+    test_default_cleared();
+    pw_deinit();
+}